@@ -0,0 +1,56 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <chrono>
+#include <iostream>
+
+#include <boost/filesystem/path.hpp>
+
+/// Shared settings of all benchmarks
+struct BenchmarkContext {
+	/// root of the example data directory
+	boost::filesystem::path data;
+	/// directory for the detailed results of benchmarks writing them as files
+	boost::filesystem::path output;
+	/// sizes of the synthetic inputs of benchmarks supporting them (the meaning depends on the benchmark)
+	std::vector<int> sizes;
+};
+
+/// A single named benchmark, registered statically by instantiating a Benchmark object
+class Benchmark {
+	public:
+		Benchmark(const std::string& name, std::function<void(const BenchmarkContext&)> fn);
+
+		const std::string& name() const;
+		void run(const BenchmarkContext& context) const;
+
+		static const std::vector<Benchmark*>& all();
+
+	private:
+		static std::vector<Benchmark*>& registry();
+
+		std::string m_name;
+		std::function<void(const BenchmarkContext&)> m_fn;
+};
+
+/// Returns the time of a single call of fn in seconds, averaged over enough calls to run for at least minTime seconds
+template<typename FN>
+double measure(FN fn, double minTime = 0.5) {
+	std::size_t iterations = 0;
+	double elapsed = 0.0;
+
+	auto start = std::chrono::high_resolution_clock::now();
+	while(elapsed < minTime) {
+		fn();
+		++iterations;
+
+		elapsed = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+
+	return elapsed / (double)iterations;
+}
+
+/// Prints a single result line
+void report(const std::string& benchmark, const std::string& variant, double value, const std::string& unit);
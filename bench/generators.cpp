@@ -0,0 +1,64 @@
+#include "generators.h"
+
+#include <cmath>
+#include <cstdio>
+#include <stdexcept>
+
+Grid makeGrid(int size) {
+	Grid result;
+
+	for(int y = 0; y <= size; ++y)
+		for(int x = 0; x <= size; ++x)
+			result.positions.push_back(Vec3((float)x / (float)size, 0.01f * (float)((x * 7 + y * 13) % 17), (float)y / (float)size));
+
+	for(int y = 0; y < size; ++y)
+		for(int x = 0; x < size; ++x) {
+			const int v = y * (size + 1) + x;
+			result.faceCounts.push_back(4);
+			result.faceIndices.insert(result.faceIndices.end(), {v, v + 1, v + size + 2, v + size + 1});
+		}
+
+	return result;
+}
+
+void writeObj(const boost::filesystem::path& path, const Grid& grid, bool attributes) {
+	FILE* f = fopen(path.string().c_str(), "w");
+	if(f == nullptr)
+		throw std::runtime_error("cannot write " + path.string());
+
+	fprintf(f, "# synthetic benchmark grid\no grid\n");
+
+	for(auto& p : grid.positions)
+		fprintf(f, "v %f %f %f\n", p.x, p.y, p.z);
+
+	if(attributes) {
+		for(auto& p : grid.positions)
+			fprintf(f, "vt %f %f\n", p.x, p.z);
+
+		fprintf(f, "vn 0.000000 1.000000 0.000000\n");
+	}
+
+	std::size_t index = 0;
+	for(auto& c : grid.faceCounts) {
+		fprintf(f, "f");
+		for(std::int32_t i = 0; i < c; ++i) {
+			const std::int32_t v = grid.faceIndices[index++] + 1;
+			if(attributes)
+				fprintf(f, " %d/%d/1", v, v);
+			else
+				fprintf(f, " %d", v);
+		}
+		fprintf(f, "\n");
+	}
+
+	fclose(f);
+}
+
+Mat4 rotationY(float angle) {
+	Mat4 tr;
+	tr[0][0] = std::cos(angle);
+	tr[0][2] = -std::sin(angle);
+	tr[2][0] = std::sin(angle);
+	tr[2][2] = std::cos(angle);
+	return tr;
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <boost/filesystem/path.hpp>
+
+#include "maths.h"
+
+/// A regular grid of quads in the unit square of the XZ plane, with a slightly bumpy surface - the synthetic input of
+/// the loading benchmarks
+struct Grid {
+	std::vector<Vec3> positions;
+	std::vector<std::int32_t> faceCounts, faceIndices;
+};
+
+/// a grid of size x size quads
+Grid makeGrid(int size);
+
+/// Writes a grid as an .obj file, optionally with texture coordinates (its XZ coordinates) and a single up normal
+void writeObj(const boost::filesystem::path& path, const Grid& grid, bool attributes = false);
+
+/// a rotation around the Y axis
+Mat4 rotationY(float angle);
@@ -0,0 +1,308 @@
+#include <cstdio>
+#include <cstdint>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iterator>
+#include <limits>
+#include <algorithm>
+#include <stdexcept>
+
+#include <sys/resource.h>
+
+#include <boost/filesystem.hpp>
+
+#include <tbb/task_arena.h>
+
+#include <Alembic/AbcCoreOgawa/All.h>
+#include <Alembic/Abc/OArchive.h>
+#include <Alembic/AbcGeom/OPolyMesh.h>
+
+#include "benchmark.h"
+#include "generators.h"
+
+#include "json.hpp"
+
+#include "maths.h"
+#include "device.h"
+#include "scene.h"
+#include "scene_loading.h"
+#include "mesh_cache.h"
+#include "profiling.h"
+
+namespace {
+
+/// each input is loaded this many times, and the fastest load is reported
+const int s_runs = 3;
+/// the instanced scenes are made of tiles of s_tileSize x s_tileSize quads
+const int s_tileSize = 8;
+
+void writeAlembic(const boost::filesystem::path& path, const Grid& grid) {
+	Alembic::Abc::OArchive archive(Alembic::AbcCoreOgawa::WriteArchive(), path.string());
+	Alembic::AbcGeom::OPolyMesh mesh(archive.getTop(), "grid");
+
+	std::vector<Alembic::Abc::V3f> positions;
+	for(auto& p : grid.positions)
+		positions.push_back(Alembic::Abc::V3f(p.x, p.y, p.z));
+
+	mesh.getSchema().set(Alembic::AbcGeom::OPolyMeshSchema::Sample(
+		Alembic::AbcGeom::P3fArraySample(positions.data(), positions.size()),
+		Alembic::AbcGeom::Int32ArraySample(grid.faceIndices.data(), grid.faceIndices.size()),
+		Alembic::AbcGeom::Int32ArraySample(grid.faceCounts.data(), grid.faceCounts.size())));
+}
+
+/// a binary glTF file of a single mesh, with each quad split into two triangles
+void writeGlb(const boost::filesystem::path& path, const Grid& grid) {
+	std::vector<std::uint32_t> indices;
+	std::size_t index = 0;
+	for(auto& c : grid.faceCounts) {
+		for(std::int32_t i = 1; i + 1 < c; ++i)
+			indices.insert(indices.end(), {(std::uint32_t)grid.faceIndices[index], (std::uint32_t)grid.faceIndices[index + i],
+			                               (std::uint32_t)grid.faceIndices[index + i + 1]});
+		index += c;
+	}
+
+	// tightly packed positions (Vec3 is padded), and their bounds required by the format
+	std::vector<float> positions;
+	Vec3 min(std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max());
+	Vec3 max(-min.x, -min.y, -min.z);
+	for(auto& p : grid.positions) {
+		positions.insert(positions.end(), {p.x, p.y, p.z});
+
+		min = Vec3(std::min(min.x, p.x), std::min(min.y, p.y), std::min(min.z, p.z));
+		max = Vec3(std::max(max.x, p.x), std::max(max.y, p.y), std::max(max.z, p.z));
+	}
+
+	const std::size_t positionBytes = positions.size() * sizeof(float);
+	const std::size_t indexBytes = indices.size() * sizeof(std::uint32_t);
+
+	const nlohmann::json source = {
+		{"asset", {{"version", "2.0"}}},
+		{"scene", 0},
+		{"scenes", {{{"nodes", {0}}}}},
+		{"nodes", {{{"mesh", 0}}}},
+		{"meshes", {{{"primitives", {{{"attributes", {{"POSITION", 0}}}, {"indices", 1}}}}}}},
+		{"buffers", {{{"byteLength", positionBytes + indexBytes}}}},
+		{"bufferViews", {
+			{{"buffer", 0}, {"byteOffset", 0}, {"byteLength", positionBytes}},
+			{{"buffer", 0}, {"byteOffset", positionBytes}, {"byteLength", indexBytes}}
+		}},
+		{"accessors", {
+			{{"bufferView", 0}, {"componentType", 5126}, {"count", grid.positions.size()}, {"type", "VEC3"},
+			 {"min", {min.x, min.y, min.z}}, {"max", {max.x, max.y, max.z}}},
+			{{"bufferView", 1}, {"componentType", 5125}, {"count", indices.size()}, {"type", "SCALAR"}}
+		}}
+	};
+
+	// chunks are 4-byte aligned, the JSON one padded with spaces (the binary one is made of 4-byte values)
+	std::string json = source.dump();
+	json.resize((json.size() + 3) / 4 * 4, ' ');
+
+	const std::uint32_t header[3] = {0x46546C67, 2, (std::uint32_t)(12 + 8 + json.size() + 8 + positionBytes + indexBytes)};
+	const std::uint32_t jsonChunk[2] = {(std::uint32_t)json.size(), 0x4E4F534A};
+	const std::uint32_t binChunk[2] = {(std::uint32_t)(positionBytes + indexBytes), 0x004E4942};
+
+	std::ofstream file(path.string(), std::ios::binary);
+	file.write((const char*)header, sizeof(header));
+	file.write((const char*)jsonChunk, sizeof(jsonChunk));
+	file.write(json.data(), json.size());
+	file.write((const char*)binChunk, sizeof(binChunk));
+	file.write((const char*)positions.data(), positionBytes);
+	file.write((const char*)indices.data(), indexBytes);
+
+	if(!file)
+		throw std::runtime_error("cannot write " + path.string());
+}
+
+/// transformations of the tiles of an instanced scene, covering the same area as a size x size grid
+std::vector<Mat4> tileTransforms(int size) {
+	const int tiles = std::max(size / s_tileSize, 1);
+
+	std::vector<Mat4> result;
+	for(int y = 0; y < tiles; ++y)
+		for(int x = 0; x < tiles; ++x) {
+			Mat4 tr;
+			tr.m[12] = (float)x;
+			tr.m[14] = (float)y;
+			result.push_back(tr);
+		}
+
+	return result;
+}
+
+nlohmann::json toJson(const Mat4& tr) {
+	return nlohmann::json(std::vector<float>(tr.m, tr.m + 16));
+}
+
+void writeJson(const boost::filesystem::path& path, const nlohmann::json& source) {
+	std::ofstream file(path.string());
+	file << source;
+}
+
+/// a scene with the instances listed inline, in the `instances` array
+void writeInlineInstances(const boost::filesystem::path& path, const std::string& tile, int size) {
+	nlohmann::json instances = nlohmann::json::array();
+	for(auto& tr : tileTransforms(size))
+		instances.push_back({{"id", 0}, {"transform", toJson(tr)}});
+
+	writeJson(path, nlohmann::json::array({{{"objects", {{{"path", tile}}}}, {"instances", instances}}}));
+}
+
+/// a scene with the instances in a binary `instance_file` - records of an id and 16 floats
+void writeInstanceFile(const boost::filesystem::path& path, const std::string& tile, int size) {
+	struct Record {
+		std::uint32_t id;
+		float transform[16];
+	};
+
+	const boost::filesystem::path binary = boost::filesystem::path(path).replace_extension(".bin");
+	{
+		std::ofstream file(binary.string(), std::ios::binary);
+		for(auto& tr : tileTransforms(size)) {
+			Record r{0, {}};
+			std::copy(tr.m, tr.m + 16, r.transform);
+			file.write((const char*)&r, sizeof(r));
+		}
+	}
+
+	writeJson(path, nlohmann::json::array({{{"objects", {{{"path", tile}}}}, {"instance_file", binary.filename().string()}}}));
+}
+
+/// loads a mesh or a scene file, the same way as the viewer does
+Scene load(const boost::filesystem::path& path) {
+	if(path.extension() != ".json")
+		return loadMesh(path);
+
+	std::string text;
+	{
+		LoadPhaseScope phase(kFileIO);
+
+		std::ifstream file(path.string());
+		text.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+	}
+
+	nlohmann::json source;
+	{
+		LoadPhaseScope phase(kParsing);
+		source = nlohmann::json::parse(text);
+	}
+
+	return parseScene(source, path.parent_path());
+}
+
+std::size_t peakRss() {
+	rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	// in kilobytes on Linux
+	return (std::size_t)usage.ru_maxrss * 1024;
+}
+
+/// loads an input s_runs times, and returns the phases of the fastest load
+nlohmann::json measureLoad(const std::string& format, int size, const std::vector<boost::filesystem::path>& files) {
+	nlohmann::json result;
+
+	std::uintmax_t fileSize = 0;
+	for(auto& f : files)
+		fileSize += boost::filesystem::file_size(f);
+
+	double bestTime = std::numeric_limits<double>::max();
+	for(int run = 0; run < s_runs; ++run) {
+		resetLoadProfile();
+
+		const auto start = std::chrono::steady_clock::now();
+		const Scene scene = load(files.front());
+		const double time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		if(time < bestTime) {
+			bestTime = time;
+
+			result["format"] = format;
+			result["size"] = size;
+			result["file_size"] = fileSize;
+			result["primitives"] = scene.statistics().primitives;
+			result["instances"] = scene.statistics().instances;
+			result["time"] = time;
+			result["embree_memory"] = Device::memoryUsage();
+
+			nlohmann::json phases;
+			for(int p = 0; p < kLoadPhaseCount; ++p) {
+				const LoadPhaseTotals totals = loadProfile((LoadPhase)p);
+				phases[loadPhaseName((LoadPhase)p)] = {{"time", totals.time}, {"memory", totals.memory}, {"count", totals.count}};
+			}
+			result["phases"] = phases;
+		}
+	}
+
+	// the process-wide peak, which only grows - inputs are loaded in the order of their sizes
+	result["peak_rss"] = peakRss();
+
+	report("scene_loading", format + " " + std::to_string(size), bestTime * 1e3, "ms");
+
+	return result;
+}
+
+void run(const BenchmarkContext& context) {
+	const MeshCacheOptions originalOptions = meshCacheOptions();
+
+	// parsing only, without the binary cache
+	MeshCacheOptions options;
+	options.enabled = false;
+	setMeshCacheOptions(options);
+
+	setLoadProfiling(true);
+
+	// keeps the shared device alive between the loads, so that its creation is not measured
+	const Device device;
+
+	const boost::filesystem::path dir = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("scene-loading-%%%%%%");
+	boost::filesystem::create_directories(dir);
+
+	// shared by the instanced scenes of all sizes
+	writeObj(dir / "tile.obj", makeGrid(s_tileSize));
+
+	nlohmann::json results = nlohmann::json::array();
+
+	std::vector<int> sizes = context.sizes;
+	std::sort(sizes.begin(), sizes.end());
+
+	for(int size : sizes) {
+		const std::string suffix = std::to_string(size);
+
+		{
+			const Grid grid = makeGrid(size);
+			writeObj(dir / ("grid-" + suffix + ".obj"), grid);
+			writeAlembic(dir / ("grid-" + suffix + ".abc"), grid);
+			writeGlb(dir / ("grid-" + suffix + ".glb"), grid);
+		}
+		writeInlineInstances(dir / ("instances-" + suffix + ".json"), "tile.obj", size);
+		writeInstanceFile(dir / ("instance-file-" + suffix + ".json"), "tile.obj", size);
+
+		results.push_back(measureLoad("obj", size, {dir / ("grid-" + suffix + ".obj")}));
+		results.push_back(measureLoad("alembic", size, {dir / ("grid-" + suffix + ".abc")}));
+		results.push_back(measureLoad("gltf", size, {dir / ("grid-" + suffix + ".glb")}));
+		results.push_back(measureLoad("json_instances", size, {dir / ("instances-" + suffix + ".json"), dir / "tile.obj"}));
+		results.push_back(measureLoad("json_instance_file", size,
+			{dir / ("instance-file-" + suffix + ".json"), dir / ("instance-file-" + suffix + ".bin"), dir / "tile.obj"}));
+	}
+
+	boost::filesystem::remove_all(dir);
+
+	setLoadProfiling(false);
+	setMeshCacheOptions(originalOptions);
+
+	const nlohmann::json document = {
+		{"benchmark", "scene_loading"},
+		{"threads", tbb::this_task_arena::max_concurrency()},
+		{"results", results}
+	};
+
+	const boost::filesystem::path output = context.output / "scene_loading.json";
+	std::ofstream file(output.string());
+	file << std::setw(4) << document << std::endl;
+
+	std::cout << "scene_loading results written to " << output << std::endl;
+}
+
+Benchmark s_benchmark("scene_loading", run);
+
+}
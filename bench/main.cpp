@@ -0,0 +1,74 @@
+#include <iostream>
+
+#include <boost/program_options.hpp>
+
+#include "benchmark.h"
+
+namespace po = boost::program_options;
+
+Benchmark::Benchmark(const std::string& name, std::function<void(const BenchmarkContext&)> fn) : m_name(name), m_fn(fn) {
+	registry().push_back(this);
+}
+
+const std::string& Benchmark::name() const {
+	return m_name;
+}
+
+void Benchmark::run(const BenchmarkContext& context) const {
+	m_fn(context);
+}
+
+std::vector<Benchmark*>& Benchmark::registry() {
+	static std::vector<Benchmark*> s_registry;
+	return s_registry;
+}
+
+const std::vector<Benchmark*>& Benchmark::all() {
+	return registry();
+}
+
+void report(const std::string& benchmark, const std::string& variant, double value, const std::string& unit) {
+	std::cout << benchmark << "\t" << variant << "\t" << value << " " << unit << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+	po::options_description desc("Allowed options");
+
+	desc.add_options()
+	("help", "produce help message")
+	("data", po::value<std::string>()->default_value("data"), "path to the example data directory")
+	("filter", po::value<std::string>()->default_value(""), "only run benchmarks with names containing this string")
+	("output", po::value<std::string>()->default_value("."), "directory to write detailed (JSON) results to")
+	("sizes", po::value<std::vector<int>>()->multitoken()->default_value(std::vector<int>{64, 256, 1024}, "64 256 1024"),
+		"sizes of synthetic inputs")
+	("list", "list all benchmarks")
+	;
+
+	po::variables_map vm;
+	po::store(po::parse_command_line(argc, argv, desc), vm);
+	po::notify(vm);
+
+	if(vm.count("help")) {
+		std::cout << desc << std::endl;
+		return 1;
+	}
+
+	if(vm.count("list")) {
+		for(auto& b : Benchmark::all())
+			std::cout << b->name() << std::endl;
+		return 0;
+	}
+
+	BenchmarkContext context;
+	context.data = vm["data"].as<std::string>();
+	context.output = vm["output"].as<std::string>();
+	context.sizes = vm["sizes"].as<std::vector<int>>();
+
+	const std::string filter = vm["filter"].as<std::string>();
+
+	for(auto& b : Benchmark::all())
+		if(b->name().find(filter) != std::string::npos)
+			b->run(context);
+
+	return 0;
+}
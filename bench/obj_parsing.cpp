@@ -0,0 +1,99 @@
+#include <boost/filesystem.hpp>
+
+#include "benchmark.h"
+#include "generators.h"
+
+#include "obj.h"
+#include "scene.h"
+#include "mesh_cache.h"
+#include "profiling.h"
+
+namespace {
+
+/// Times of loading a set of files in seconds - the whole loadObj() calls, and their parsing phase only (the chunked
+/// text parsing into intermediate arrays, without building and committing the meshes)
+struct LoadTimes {
+	double load = 0.0;
+	double parsing = 0.0;
+};
+
+LoadTimes measureLoads(const std::vector<boost::filesystem::path>& files) {
+	LoadTimes result;
+
+	resetLoadProfile();
+	result.load = measure([&]() {
+		for(auto& p : files)
+			Scene s = loadObj(p);
+	}, 2.0);
+
+	// one parsing phase per file and call of the measured function (none for cached loads)
+	const LoadPhaseTotals parsing = loadProfile(kParsing);
+	if(parsing.count > 0)
+		result.parsing = parsing.time / (double)parsing.count * (double)files.size();
+
+	return result;
+}
+
+/// reports the throughput of the parsing phase (if any) and of the whole load
+void reportLoads(const std::string& variant, double size, const LoadTimes& times) {
+	if(times.parsing > 0.0)
+		report("obj_parsing", variant + " parsing", size / times.parsing / 1024.0 / 1024.0, "MB/s");
+	report("obj_parsing", variant + " load", size / times.load / 1024.0 / 1024.0, "MB/s");
+}
+
+void run(const BenchmarkContext& context) {
+	const MeshCacheOptions originalOptions = meshCacheOptions();
+
+	// parsing only, without the binary cache
+	MeshCacheOptions options;
+	options.enabled = false;
+	setMeshCacheOptions(options);
+
+	setLoadProfiling(true);
+
+	// a synthetic file big enough to make the per-file overheads negligible
+	const boost::filesystem::path grid = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("grid-%%%%%%.obj");
+	writeObj(grid, makeGrid(1000), true);
+
+	const double gridSize = (double)boost::filesystem::file_size(grid);
+	const LoadTimes gridTimes = measureLoads({grid});
+
+	boost::filesystem::remove(grid);
+
+	reportLoads("synthetic grid", gridSize, gridTimes);
+
+	// all the grass blades
+	std::vector<boost::filesystem::path> grass;
+	double grassSize = 0.0;
+	if(boost::filesystem::exists(context.data / "Grass"))
+		for(auto& entry : boost::filesystem::directory_iterator(context.data / "Grass"))
+			if(entry.path().extension() == ".obj") {
+				grass.push_back(entry.path());
+				grassSize += (double)boost::filesystem::file_size(entry.path());
+			}
+
+	if(!grass.empty()) {
+		reportLoads("grass assets", grassSize, measureLoads(grass));
+
+		// warm loads from the binary cache, written to a temporary directory by the first load
+		options.enabled = true;
+		options.directory = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("meshcache-%%%%%%");
+		setMeshCacheOptions(options);
+
+		for(auto& p : grass)
+			Scene s = loadObj(p);
+
+		const LoadTimes cachedTimes = measureLoads(grass);
+
+		boost::filesystem::remove_all(options.directory);
+
+		reportLoads("grass assets (cached)", grassSize, cachedTimes);
+	}
+
+	setLoadProfiling(false);
+	setMeshCacheOptions(originalOptions);
+}
+
+Benchmark s_benchmark("obj_parsing", run);
+
+}
@@ -0,0 +1,212 @@
+#include <cmath>
+#include <fstream>
+#include <algorithm>
+
+#include <boost/filesystem.hpp>
+
+#include <SDL2/SDL.h>
+
+#include "benchmark.h"
+#include "generators.h"
+
+#include "json.hpp"
+
+#include "maths.h"
+#include "mesh.h"
+#include "scene.h"
+#include "scene_loading.h"
+#include "shading.h"
+
+namespace {
+
+/// resolution of the images of rays, which makes one call of a measured function
+const int s_imageSize = 512;
+/// number of tiles along each side of an image, as in the renderer
+const int s_tileSubdiv = 8;
+/// number of spheres along each side of the synthetic scene's grid
+const int s_sphereGrid = 8;
+
+/// results are accumulated here, so that the compiler cannot remove the measured code
+volatile float s_sink = 0.0f;
+
+/// reports the time of one operation, and the number of operations per second
+void reportOps(const std::string& benchmark, const std::string& variant, double time, double ops, const std::string& unit) {
+	report(benchmark, variant + " time", time / ops * 1e9, "ns/op");
+	report(benchmark, variant + " throughput", ops / time / 1e6, "M" + unit + "/s");
+}
+
+/// screen coordinates in -1..1 of the pixels of an image, as passed to Camera::makeRay
+float screen(int i) {
+	return (float)i / (float)s_imageSize * 2.0f - 1.0f;
+}
+
+/// a regular grid of tessellated spheres, all visible from the default camera
+Scene makeSpheres() {
+	Scene result;
+
+	for(int x = 0; x < s_sphereGrid; ++x)
+		for(int y = 0; y < s_sphereGrid; ++y)
+			for(int z = 0; z < s_sphereGrid; ++z) {
+				const Vec3 center((x - s_sphereGrid / 2) * 30.0f, (y - s_sphereGrid / 2) * 30.0f, (z - s_sphereGrid / 2) * 30.0f);
+				result.addMesh(Mesh::makeSphere(center, 10.0f, 32, 64));
+			}
+
+	result.commit();
+
+	return result;
+}
+
+/// loads a scene file (.json)
+Scene loadScene(const boost::filesystem::path& path) {
+	nlohmann::json source;
+	{
+		std::ifstream file(path.string());
+		file >> source;
+	}
+
+	Scene result = parseScene(source, path.parent_path());
+	result.commit();
+
+	return result;
+}
+
+void runCamera(const BenchmarkContext& /*context*/) {
+	const double rays = (double)s_imageSize * (double)s_imageSize;
+
+	Camera cam;
+	cam.position = Vec3(10, 20, -500);
+
+	const double makeRay = measure([&]() {
+		float sum = 0.0f;
+		for(int y = 0; y < s_imageSize; ++y)
+			for(int x = 0; x < s_imageSize; ++x)
+				sum += cam.makeRay(screen(x), screen(y)).direction.x;
+		s_sink = s_sink + sum;
+	});
+	reportOps("camera_rays", "makeRay", makeRay, rays, "rays");
+
+	const double pixelRay = measure([&]() {
+		float sum = 0.0f;
+		for(int y = 0; y < s_imageSize; ++y)
+			for(int x = 0; x < s_imageSize; ++x)
+				sum += cam.pixelRay(x, y, s_imageSize, s_imageSize).direction.x;
+		s_sink = s_sink + sum;
+	});
+	reportOps("camera_rays", "pixelRay", pixelRay, rays, "rays");
+
+	// the renderer's primary rays, including their setup for Embree
+	RTCRayHit rayhit;
+	const double primary = measure([&]() {
+		float sum = 0.0f;
+		for(int y = 0; y < s_imageSize; ++y)
+			for(int x = 0; x < s_imageSize; ++x) {
+				primaryRay(cam, x, y, s_imageSize, s_imageSize, rayhit);
+				sum += rayhit.ray.dir_x;
+			}
+		s_sink = s_sink + sum;
+	});
+	reportOps("camera_rays", "primaryRay", primary, rays, "rays");
+}
+
+void runMatrix(const BenchmarkContext& /*context*/) {
+	static const int s_count = 1 << 16;
+
+	const Mat4 rotation = rotationY(0.01f);
+
+	const double time = measure([&]() {
+		Mat4 m;
+		for(int i = 0; i < s_count; ++i)
+			m = m * rotation;
+		s_sink = s_sink + m[0][0];
+	});
+	reportOps("matrix_multiply", "Mat4 * Mat4", time, s_count, "ops");
+}
+
+void runPixelPacking(const BenchmarkContext& /*context*/) {
+	const double pixelCount = (double)s_imageSize * (double)s_imageSize;
+
+	SDL_PixelFormat* format = SDL_AllocFormat(SDL_PIXELFORMAT_RGB888);
+
+	std::vector<float> values(s_imageSize * s_imageSize);
+	for(std::size_t i = 0; i < values.size(); ++i)
+		values[i] = (float)(i % 1021) / 1000.0f;
+	std::vector<Uint32> pixels(values.size());
+
+	const double time = measure([&]() {
+		for(std::size_t i = 0; i < values.size(); ++i)
+			pixels[i] = packGray(values[i], *format);
+		s_sink = s_sink + pixels[s_imageSize];
+	});
+	reportOps("pixel_packing", "packGray", time, pixelCount, "pixels");
+
+	SDL_FreeFormat(format);
+}
+
+void runTrace(const BenchmarkContext& context) {
+	const double rays = (double)s_imageSize * (double)s_imageSize;
+
+	std::vector<std::pair<Scene, std::string>> scenes;
+	scenes.emplace_back(makeSpheres(), "spheres");
+
+	const boost::filesystem::path grass = context.data / "Grass" / "scene.json";
+	if(boost::filesystem::exists(grass))
+		scenes.emplace_back(loadScene(grass), "grass");
+	else
+		std::cerr << "grass scene not found in " << context.data << std::endl;
+
+	// the default camera of the viewer, on a single thread
+	const Camera cam;
+
+	SDL_PixelFormat* format = SDL_AllocFormat(SDL_PIXELFORMAT_RGB888);
+
+	for(auto& s : scenes) {
+		const Scene& scene = s.first;
+
+		// the ray generation is included, as in the renderer
+		std::size_t hits = 0;
+		const double trace = measure([&]() {
+			hits = 0;
+			for(int y = 0; y < s_imageSize; ++y)
+				for(int x = 0; x < s_imageSize; ++x)
+					hits += scene.trace(cam.pixelRay(x, y, s_imageSize, s_imageSize)).hit.geomID != RTC_INVALID_GEOMETRY_ID;
+		}, 1.0);
+		reportOps("scene_trace", s.second + " trace", trace, rays, "rays");
+		report("scene_trace", s.second + " hit ratio", (double)hits / rays, "");
+
+		// the G-buffer fill of the renderer's traceTile(), on its tiles - each tile's primary rays are traced as a
+		// stream, and their hits keep the position and the shading normal facing the camera
+		std::vector<Vec3> positions(s_imageSize * s_imageSize), normals(s_imageSize * s_imageSize);
+		std::vector<RTCRayHit> primary;
+
+		const double gbuffer = measure([&]() {
+			for(int tileId = 0; tileId < s_tileSubdiv * s_tileSubdiv; ++tileId) {
+				const int xMin = ((tileId % s_tileSubdiv) * s_imageSize) / s_tileSubdiv;
+				const int xMax = ((tileId % s_tileSubdiv + 1) * s_imageSize) / s_tileSubdiv;
+				const int yMin = ((tileId / s_tileSubdiv) * s_imageSize) / s_tileSubdiv;
+				const int yMax = ((tileId / s_tileSubdiv + 1) * s_imageSize) / s_tileSubdiv;
+
+				tracePrimaryTile(scene, cam, s_imageSize, s_imageSize, xMin, xMax, yMin, yMax, primary);
+				writePrimaryHits(scene, primary, s_imageSize, xMin, xMax, yMin, positions.data(), normals.data());
+			}
+		}, 1.0);
+		reportOps("scene_trace", s.second + " gbuffer", gbuffer, rays, "rays");
+
+		// the facing ratio shading of the G-buffer, as by the renderer's renderTileFacing()
+		std::vector<Uint32> pixels(s_imageSize * s_imageSize);
+		const double facing = measure([&]() {
+			for(std::size_t i = 0; i < pixels.size(); ++i)
+				pixels[i] = packGray(facingRatio(cam.position, positions[i], normals[i]), *format);
+			s_sink = s_sink + pixels[pixels.size() / 2];
+		});
+		reportOps("scene_trace", s.second + " facing", facing, rays, "pixels");
+	}
+
+	SDL_FreeFormat(format);
+}
+
+Benchmark s_camera("camera_rays", runCamera);
+Benchmark s_matrix("matrix_multiply", runMatrix);
+Benchmark s_pixelPacking("pixel_packing", runPixelPacking);
+Benchmark s_trace("scene_trace", runTrace);
+
+}
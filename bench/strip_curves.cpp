@@ -0,0 +1,104 @@
+#include <random>
+#include <iomanip>
+#include <sstream>
+#include <atomic>
+
+#include <boost/filesystem.hpp>
+
+#include <tbb/parallel_for.h>
+
+#include "benchmark.h"
+#include "generators.h"
+
+#include "obj.h"
+#include "scene.h"
+#include "device.h"
+
+namespace {
+
+/// number of grass blades along each side of the benchmark field
+const int s_fieldSize = 200;
+/// distance between blades
+const float s_fieldSpacing = 0.1f;
+/// resolution of the traced image
+const int s_imageSize = 1024;
+
+void run(const BenchmarkContext& context) {
+	const std::pair<StripCurves, std::string> variants[] = {
+		{kNoStripCurves, "triangles"},
+		{kLinearStripCurves, "linear"},
+		{kBezierStripCurves, "bezier"}
+	};
+
+	for(auto& variant : variants) {
+		const std::size_t memoryBefore = Device::memoryUsage();
+
+		// load all grass blades, as separate instanceable scenes
+		std::vector<Scene> blades;
+		for(int i = 1; i <= 20; ++i) {
+			std::stringstream name;
+			name << std::setw(2) << std::setfill('0') << i << ".obj";
+
+			const boost::filesystem::path path = context.data / "Grass" / name.str();
+			if(boost::filesystem::exists(path)) {
+				blades.push_back(loadObj(path, variant.first));
+				blades.back().commit();
+			}
+		}
+
+		if(blades.empty()) {
+			std::cerr << "grass assets not found in " << context.data << std::endl;
+			return;
+		}
+
+		const std::size_t geometryMemory = Device::memoryUsage() - memoryBefore;
+
+		// scatter them on a regular grid, with random rotations
+		std::mt19937 rng(0);
+		std::uniform_real_distribution<float> angle(0.0f, 2.0f * M_PI);
+
+		Scene field;
+		for(int x = 0; x < s_fieldSize; ++x)
+			for(int z = 0; z < s_fieldSize; ++z) {
+				const Scene& blade = blades[(x * s_fieldSize + z) % blades.size()];
+
+				Mat4 tr = rotationY(angle(rng));
+				tr[3][0] = (x - s_fieldSize / 2) * s_fieldSpacing;
+				tr[3][2] = (z - s_fieldSize / 2) * s_fieldSpacing;
+				field.addInstance(blade, tr);
+			}
+		field.commit();
+
+		const std::size_t totalMemory = Device::memoryUsage() - memoryBefore;
+
+		// a grazing view across the field
+		Camera cam;
+		cam.position = Vec3(0, 3, -s_fieldSize * s_fieldSpacing * 0.6f);
+		cam.target = Vec3(0, 0, 0);
+
+		std::atomic<std::size_t> hits(0);
+		const double time = measure([&]() {
+			hits = 0;
+
+			tbb::parallel_for(0, s_imageSize, [&](int y) {
+				std::size_t rowHits = 0;
+				for(int x = 0; x < s_imageSize; ++x) {
+					const Ray r = cam.makeRay((float)x / (float)s_imageSize * 2.0f - 1.0f, (float)y / (float)s_imageSize * 2.0f - 1.0f);
+					rowHits += field.trace(r).hit.geomID != RTC_INVALID_GEOMETRY_ID;
+				}
+				hits += rowHits;
+			});
+		}, 2.0);
+
+		const double rays = (double)s_imageSize * (double)s_imageSize;
+
+		report("grass_strip_curves", variant.second + " blade memory", (double)geometryMemory / 1024.0, "KB");
+		report("grass_strip_curves", variant.second + " total memory", (double)totalMemory / 1024.0 / 1024.0, "MB");
+		report("grass_strip_curves", variant.second + " throughput", rays / time / 1e6, "Mrays/s");
+		report("grass_strip_curves", variant.second + " hit ratio", (double)hits / rays, "");
+	}
+}
+
+Benchmark s_benchmark("grass_strip_curves", run);
+
+}
@@ -1,97 +1,495 @@
 #include "alembic.h"
 
+#include <map>
+#include <algorithm>
+#include <numeric>
+
+#include <boost/algorithm/string/split.hpp>
+#include <boost/algorithm/string/classification.hpp>
+
+#include <tbb/parallel_for.h>
+#include <tbb/enumerable_thread_specific.h>
+
 #include <Alembic/AbcCoreFactory/IFactory.h>
 
 #include <Alembic/AbcGeom/IXform.h>
 #include <Alembic/AbcGeom/IPolyMesh.h>
+#include <Alembic/AbcGeom/ISubD.h>
+#include <Alembic/AbcGeom/ICurves.h>
 
+#include "device.h"
 #include "mesh.h"
+#include "mesh_building.h"
+#include "subdivision.h"
+#include "curves.h"
+#include "profiling.h"
 
 namespace {
 
-void extractMeshes(std::vector<Mesh>& meshes, const Alembic::Abc::IObject& obj, const Alembic::Abc::M44d& current = Alembic::Abc::M44d(1,0,0,0,0,1,0,0,0,0,1,0,0,0,0,1)) {
+AlembicOptions s_options;
+
+/// A single unique mesh in the archive, with all the transformations it is instanced with
+struct MeshInstances {
+	std::string path;
+	std::vector<Mat4> transforms;
+};
+
+Mat4 toMat4(const Alembic::Abc::M44d& m) {
+	// both Imath and Embree's column-major format store the translation in elements 12-14
+	Mat4 result;
+	for(std::size_t i = 0; i < 16; ++i)
+		result.m[i] = m[i / 4][i % 4];
+	return result;
+}
+
+bool isIdentity(const Mat4& m) {
+	static const Mat4 s_identity;
+	return std::equal(m.m, m.m + 16, s_identity.m);
+}
+
+/// Returns a key identifying the data of a mesh object. Instanced objects (and objects with identical
+/// data, which Ogawa stores only once) share the same properties hash.
+std::string meshKey(Alembic::Abc::IObject obj) {
+	Alembic::Util::Digest digest;
+	if(obj.getPropertiesHash(digest))
+		return digest.str();
+
+	if(obj.isInstanceRoot())
+		return obj.instanceSourcePath();
+
+	return obj.getFullName();
+}
+
+void collectMeshes(std::map<std::string, MeshInstances>& meshes, const Alembic::Abc::IObject& obj, const Alembic::Abc::M44d& current = Alembic::Abc::M44d(1,0,0,0,0,1,0,0,0,0,1,0,0,0,0,1)) {
 	if(Alembic::AbcGeom::IXform::matches(obj.getHeader())) {
 		Alembic::AbcGeom::IXform xform(obj, Alembic::Abc::kWrapExisting);
 
 		Alembic::AbcGeom::XformSample value = xform.getSchema().getValue();
-		Alembic::Abc::M44d matrix = value.getMatrix() * current;
+		Alembic::Abc::M44d matrix = value.getMatrix();
+		if(value.getInheritsXforms())
+			matrix = matrix * current;
 
 		for(std::size_t i = 0; i < obj.getNumChildren(); ++i)
-			extractMeshes(meshes, obj.getChild(i), matrix);
+			collectMeshes(meshes, obj.getChild(i), matrix);
 	}
 
-	else if(Alembic::AbcGeom::IPolyMesh::matches(obj.getHeader())) {
-		Alembic::AbcGeom::IPolyMesh inmesh(obj, Alembic::Abc::kWrapExisting);
+	else if(Alembic::AbcGeom::IPolyMesh::matches(obj.getHeader()) || Alembic::AbcGeom::ISubD::matches(obj.getHeader()) ||
+	        Alembic::AbcGeom::ICurves::matches(obj.getHeader())) {
+		MeshInstances& item = meshes[meshKey(obj)];
+		if(item.path.empty())
+			item.path = obj.getFullName();
 
-		Alembic::AbcGeom::IPolyMeshSchema::Sample value = inmesh.getSchema().getValue();
+		item.transforms.push_back(toMat4(current));
+	}
 
-		Alembic::Abc::Int32ArraySamplePtr faceCounts = value.getFaceCounts();
-		Alembic::Abc::Int32ArraySamplePtr faceIndices = value.getFaceIndices();
-		Alembic::Abc::P3fArraySamplePtr positions = value.getPositions();
+	else
+		for(std::size_t i = 0; i < obj.getNumChildren(); ++i)
+			collectMeshes(meshes, obj.getChild(i), current);
+}
+
+/// Finds an object by its full path (works for instance proxies as well)
+Alembic::Abc::IObject findObject(const Alembic::Abc::IArchive& archive, const std::string& path) {
+	std::vector<std::string> names;
+	boost::algorithm::split(names, path, boost::algorithm::is_any_of("/"), boost::algorithm::token_compress_on);
+
+	Alembic::Abc::IObject result = archive.getTop();
+	for(auto& n : names)
+		if(!n.empty()) {
+			result = result.getChild(n);
+			if(!result.valid())
+				throw std::runtime_error("object not found in Alembic archive - " + path);
+		}
 
-		// count the number of triangles
-		std::size_t triangleCount = 0;
-		for(std::size_t i = 0; i < faceCounts->size(); ++i)
-			triangleCount += (*faceCounts)[i] - 2;
+	return result;
+}
 
-		// make the mesh instance and transfer the data
-		Mesh mesh(positions->size(), triangleCount);
+Alembic::AbcCoreFactory::IFactory makeFactory() {
+	Alembic::AbcCoreFactory::IFactory factory;
 
-		for(std::size_t i = 0; i < positions->size(); ++i) {
-			const Imath::V3f pf = (*positions)[i];
+	if(s_options.readStrategy == AlembicOptions::kFileStreams)
+		factory.setOgawaReadStrategy(Alembic::AbcCoreFactory::IFactory::kFileStreams);
+	else
+		factory.setOgawaReadStrategy(Alembic::AbcCoreFactory::IFactory::kMemoryMappedFiles);
 
-			Imath::V3f pd = Imath::V3d(pf.x, pf.y, pf.z) * current;
+	factory.setOgawaNumStreams(std::max(s_options.numStreams, (std::size_t)1));
 
-			mesh.vertices()[i] = Vec3(pd.x, pd.y, pd.z);
+	return factory;
+}
+
+/// Decoded geometry of a single unique object (only one of the pointers is set)
+struct Geometry {
+	std::unique_ptr<Mesh> mesh;
+	std::unique_ptr<SubdivisionMesh> subdiv;
+	std::unique_ptr<Curves> curves;
+
+	void addTo(Scene& scene) {
+		if(mesh)
+			scene.addMesh(std::move(*mesh));
+		else if(subdiv)
+			scene.addMesh(std::move(*subdiv));
+		else if(curves)
+			scene.addMesh(std::move(*curves));
+
+		mesh.reset();
+		subdiv.reset();
+		curves.reset();
+	}
+};
+
+template<typename T>
+std::size_t sampleSize(const std::shared_ptr<T>& sample) {
+	// optional properties, when not present in the file, return null samples
+	return sample ? sample->size() : 0;
+}
+
+Geometry makePolyMesh(const Alembic::Abc::IObject& obj) {
+	Alembic::AbcGeom::IPolyMesh inmesh(obj, Alembic::Abc::kWrapExisting);
+
+	Alembic::AbcGeom::IPolyMeshSchema::Sample value;
+	{
+		LoadPhaseScope phase(kFileIO);
+		inmesh.getSchema().get(value);
+	}
+
+	Alembic::Abc::Int32ArraySamplePtr faceCounts = value.getFaceCounts();
+	Alembic::Abc::Int32ArraySamplePtr faceIndices = value.getFaceIndices();
+	Alembic::Abc::P3fArraySamplePtr positions = value.getPositions();
+
+	// the mesh is built in object space - transformations are handled by instancing
+	Geometry result;
+
+	// normals are either per-vertex, or per polygon corner (optionally indexed)
+	Alembic::AbcGeom::IN3fGeomParam normalsParam = inmesh.getSchema().getNormalsParam();
+	if(normalsParam.valid()) {
+		Alembic::AbcGeom::IN3fGeomParam::Sample normals = normalsParam.getIndexedValue();
+		const Alembic::AbcGeom::GeometryScope scope = normalsParam.getScope();
+		const float* values = reinterpret_cast<const float*>(normals.getVals()->get());
+
+		if((scope == Alembic::AbcGeom::kVertexScope || scope == Alembic::AbcGeom::kVaryingScope) && !normals.isIndexed() &&
+		   normals.getVals()->size() == positions->size()) {
+			result.mesh.reset(new Mesh(makePolygonMesh(reinterpret_cast<const float*>(positions->get()), positions->size(), 3,
+			                                           faceCounts->get(), faceCounts->size(), faceIndices->get(), values, 3)));
+			return result;
 		}
 
-		{
-			std::size_t triangleIndex = 0;
-			std::size_t vertexIndex = 0;
-			for(std::size_t i = 0; i < faceCounts->size(); ++i) {
-				const std::size_t faceCount = (*faceCounts)[i];
-				assert(faceCount >= 3);
-				for(std::size_t i = 1; i < faceCount - 1; ++i) {
-					Triangle& tr = mesh.triangles()[triangleIndex];
-
-					tr.v0 = (*faceIndices)[vertexIndex];
-					tr.v1 = (*faceIndices)[vertexIndex + i];
-					tr.v2 = (*faceIndices)[vertexIndex + i+1];
-
-					++triangleIndex;
-				}
-				vertexIndex += faceCount;
+		if(scope == Alembic::AbcGeom::kFacevaryingScope) {
+			std::vector<std::int32_t> normalIndices(faceIndices->size());
+			if(normals.isIndexed() && normals.getIndices()->size() == normalIndices.size())
+				std::copy(normals.getIndices()->get(), normals.getIndices()->get() + normalIndices.size(), normalIndices.begin());
+			else if(!normals.isIndexed() && normals.getVals()->size() == normalIndices.size())
+				std::iota(normalIndices.begin(), normalIndices.end(), 0);
+			else
+				normalIndices.clear();
+
+			const bool valid = !normalIndices.empty() && std::all_of(normalIndices.begin(), normalIndices.end(), [&](std::int32_t i) {
+				return i >= 0 && (std::size_t)i < normals.getVals()->size();
+			});
+
+			if(valid) {
+				result.mesh.reset(new Mesh(makePolygonMesh(reinterpret_cast<const float*>(positions->get()), positions->size(), 3,
+				                                           faceCounts->get(), faceCounts->size(), faceIndices->get(), values, 3,
+				                                           normalIndices.data())));
+				return result;
+			}
+		}
+	}
+
+	result.mesh.reset(new Mesh(makePolygonMesh(reinterpret_cast<const float*>(positions->get()), positions->size(), 3,
+	                                           faceCounts->get(), faceCounts->size(), faceIndices->get())));
+	return result;
+}
+
+Geometry makeSubdivision(const Alembic::Abc::IObject& obj) {
+	Alembic::AbcGeom::ISubD insubd(obj, Alembic::Abc::kWrapExisting);
+
+	Alembic::AbcGeom::ISubDSchema::Sample value;
+	{
+		LoadPhaseScope phase(kFileIO);
+		insubd.getSchema().get(value);
+	}
+
+	Alembic::Abc::Int32ArraySamplePtr faceCounts = value.getFaceCounts();
+	Alembic::Abc::Int32ArraySamplePtr faceIndices = value.getFaceIndices();
+	Alembic::Abc::P3fArraySamplePtr positions = value.getPositions();
+
+	Geometry result;
+
+	// Embree only supports Catmull-Clark subdivision - other schemes are rendered as their control cage
+	if(value.getSubdivisionScheme() != "catmull-clark") {
+		result.mesh.reset(new Mesh(makePolygonMesh(reinterpret_cast<const float*>(positions->get()), positions->size(), 3,
+		                                           faceCounts->get(), faceCounts->size(), faceIndices->get())));
+		return result;
+	}
+
+	Alembic::Abc::Int32ArraySamplePtr creaseIndices = value.getCreaseIndices();
+	Alembic::Abc::Int32ArraySamplePtr creaseLengths = value.getCreaseLengths();
+	Alembic::Abc::FloatArraySamplePtr creaseSharpnesses = value.getCreaseSharpnesses();
+	Alembic::Abc::Int32ArraySamplePtr cornerIndices = value.getCornerIndices();
+	Alembic::Abc::FloatArraySamplePtr cornerSharpnesses = value.getCornerSharpnesses();
+	Alembic::Abc::Int32ArraySamplePtr holes = value.getHoles();
+
+	// creases are stored as chains of vertices - Embree needs individual edges
+	std::size_t edgeCount = 0;
+	for(std::size_t c = 0; c < sampleSize(creaseLengths); ++c)
+		edgeCount += std::max((*creaseLengths)[c] - 1, 0);
+
+	// sharpness can be stored either per crease, or per edge
+	const bool perEdgeSharpness = sampleSize(creaseSharpnesses) == edgeCount;
+	if(!perEdgeSharpness && sampleSize(creaseSharpnesses) != sampleSize(creaseLengths))
+		throw std::runtime_error("inconsistent crease sharpness data in " + obj.getFullName());
+
+	const std::size_t cornerCount = std::min(sampleSize(cornerIndices), sampleSize(cornerSharpnesses));
+
+	result.subdiv.reset(new SubdivisionMesh(positions->size(), faceCounts->size(), faceIndices->size(),
+	                                        edgeCount, cornerCount, sampleSize(holes)));
+	SubdivisionMesh& mesh = *result.subdiv;
+
+	for(std::size_t i = 0; i < positions->size(); ++i) {
+		const Imath::V3f& p = (*positions)[i];
+		mesh.vertices()[i] = Vec3(p.x, p.y, p.z);
+	}
+
+	std::copy(faceCounts->get(), faceCounts->get() + faceCounts->size(), mesh.faces().begin());
+	std::copy(faceIndices->get(), faceIndices->get() + faceIndices->size(), mesh.indices().begin());
+
+	{
+		std::size_t index = 0;
+		std::size_t edge = 0;
+		for(std::size_t c = 0; c < sampleSize(creaseLengths); ++c) {
+			const std::int32_t length = (*creaseLengths)[c];
+			for(std::int32_t v = 0; v < length - 1; ++v) {
+				mesh.edgeCreases()[edge] = SubdivisionMesh::Edge{
+					(unsigned)(*creaseIndices)[index + v],
+					(unsigned)(*creaseIndices)[index + v + 1]
+				};
+				mesh.edgeCreaseWeights()[edge] = (*creaseSharpnesses)[perEdgeSharpness ? edge : c];
+
+				++edge;
 			}
 
-			assert(triangleIndex == mesh.triangles().size());
-			assert(vertexIndex == faceIndices->size());
+			index += length;
 		}
 
-		meshes.push_back(std::move(mesh));
+		assert(edge == edgeCount);
 	}
 
-	else
-		for(std::size_t i = 0; i < obj.getNumChildren(); ++i)
-			extractMeshes(meshes, obj.getChild(i), current);
+	for(std::size_t c = 0; c < cornerCount; ++c) {
+		mesh.vertexCreases()[c] = (*cornerIndices)[c];
+		mesh.vertexCreaseWeights()[c] = (*cornerSharpnesses)[c];
+	}
+
+	if(holes)
+		std::copy(holes->get(), holes->get() + holes->size(), mesh.holes().begin());
+
+	// RenderMan's interpolateboundary tag values
+	switch(value.getInterpolateBoundary()) {
+		case 0:
+			mesh.setBoundaryMode(RTC_SUBDIVISION_MODE_NO_BOUNDARY);
+			break;
+		case 1:
+			mesh.setBoundaryMode(RTC_SUBDIVISION_MODE_PIN_CORNERS);
+			break;
+		default:
+			mesh.setBoundaryMode(RTC_SUBDIVISION_MODE_SMOOTH_BOUNDARY);
+			break;
+	}
+
+	mesh.setTessellationRate(s_options.tessellationRate);
+
+	return result;
 }
 
+/// width of curves without the widths property
+const float s_defaultCurveWidth = 0.1f;
+
+Geometry makeCurves(const Alembic::Abc::IObject& obj) {
+	Alembic::AbcGeom::ICurves incurves(obj, Alembic::Abc::kWrapExisting);
+
+	Alembic::AbcGeom::ICurvesSchema::Sample value;
+	{
+		LoadPhaseScope phase(kFileIO);
+		incurves.getSchema().get(value);
+	}
+
+	Alembic::Abc::P3fArraySamplePtr positions = value.getPositions();
+	Alembic::Abc::Int32ArraySamplePtr numVertices = value.getCurvesNumVertices();
+
+	// widths can be constant, per curve or per vertex
+	Alembic::Abc::FloatArraySamplePtr widths;
+	if(incurves.getSchema().getWidthsParam().valid())
+		widths = incurves.getSchema().getWidthsParam().getExpandedValue().getVals();
+
+	Curves::Basis basis = Curves::kLinear;
+	bool catmullRom = false;
+	if(value.getType() != Alembic::AbcGeom::kLinear) {
+		switch(value.getBasis()) {
+			case Alembic::AbcGeom::kBezierBasis:
+				basis = Curves::kBezier;
+				break;
+			case Alembic::AbcGeom::kBsplineBasis:
+				basis = Curves::kBSpline;
+				break;
+			case Alembic::AbcGeom::kCatmullromBasis:
+				// converted to Bezier segments below
+				basis = Curves::kBezier;
+				catmullRom = true;
+				break;
+			default:
+				throw std::runtime_error("unsupported curve basis in " + obj.getFullName());
+		}
+	}
+
+	auto vertex = [&](std::size_t curve, std::size_t index) {
+		const Imath::V3f& p = (*positions)[index];
+
+		float width = s_defaultCurveWidth;
+		if(sampleSize(widths) == positions->size())
+			width = (*widths)[index];
+		else if(sampleSize(widths) == numVertices->size())
+			width = (*widths)[curve];
+		else if(sampleSize(widths) > 0)
+			width = (*widths)[0];
+
+		return CurveVertex{p.x, p.y, p.z, width * 0.5f};
+	};
+
+	std::vector<CurveVertex> vertices;
+	std::vector<unsigned> segments;
+
+	std::size_t first = 0;
+	for(std::size_t c = 0; c < numVertices->size(); ++c) {
+		const std::size_t count = (*numVertices)[c];
+
+		if(catmullRom) {
+			// a Catmull-Rom segment between points 1 and 2 is a Bezier segment with tangents (p2 - p0) / 2 and (p3 - p1) / 2
+			for(std::size_t i = 0; i + 3 < count; ++i) {
+				const CurveVertex p0 = vertex(c, first + i);
+				const CurveVertex p1 = vertex(c, first + i + 1);
+				const CurveVertex p2 = vertex(c, first + i + 2);
+				const CurveVertex p3 = vertex(c, first + i + 3);
+
+				segments.push_back(vertices.size());
+				vertices.push_back(p1);
+				vertices.push_back(CurveVertex{p1.x + (p2.x - p0.x) / 6.0f, p1.y + (p2.y - p0.y) / 6.0f, p1.z + (p2.z - p0.z) / 6.0f, p1.r + (p2.r - p0.r) / 6.0f});
+				vertices.push_back(CurveVertex{p2.x - (p3.x - p1.x) / 6.0f, p2.y - (p3.y - p1.y) / 6.0f, p2.z - (p3.z - p1.z) / 6.0f, p2.r - (p3.r - p1.r) / 6.0f});
+				vertices.push_back(p2);
+			}
+		}
+
+		else {
+			// indices of the first control vertex of each segment
+			const std::size_t begin = vertices.size();
+			if(basis == Curves::kLinear)
+				for(std::size_t i = 0; i + 1 < count; ++i)
+					segments.push_back(begin + i);
+			else if(basis == Curves::kBezier)
+				for(std::size_t i = 0; i + 3 < count; i += 3)
+					segments.push_back(begin + i);
+			else
+				for(std::size_t i = 0; i + 3 < count; ++i)
+					segments.push_back(begin + i);
+
+			for(std::size_t i = 0; i < count; ++i)
+				vertices.push_back(vertex(c, first + i));
+		}
+
+		first += count;
+	}
+
+	Geometry result;
+	if(segments.empty())
+		return result;
+
+	result.curves.reset(new Curves(basis, vertices.size(), segments.size()));
+	std::copy(vertices.begin(), vertices.end(), result.curves->vertices().begin());
+	std::copy(segments.begin(), segments.end(), result.curves->segments().begin());
+
+	return result;
+}
+
+Geometry makeGeometry(const Alembic::Abc::IObject& obj) {
+	if(Alembic::AbcGeom::ISubD::matches(obj.getHeader()))
+		return makeSubdivision(obj);
+
+	if(Alembic::AbcGeom::ICurves::matches(obj.getHeader()))
+		return makeCurves(obj);
+
+	return makePolyMesh(obj);
+}
+
+}
+
+void setAlembicOptions(const AlembicOptions& options) {
+	s_options = options;
 }
 
 Scene loadAlembic(boost::filesystem::path path) {
-	static Alembic::AbcCoreFactory::IFactory s_factory;
+	TraceScope scope("loadAlembic");
 
-	Alembic::Abc::IArchive archive = s_factory.getArchive(path.string());
+	// traverse the object hierarchy first - this only reads the object headers and transformations
+	std::vector<MeshInstances> meshes;
+	{
+		Alembic::Abc::IArchive archive;
+		{
+			LoadPhaseScope phase(kFileIO);
+			archive = makeFactory().getArchive(path.string());
+		}
+		if(!archive.valid())
+			throw std::runtime_error("cannot open Alembic archive - " + path.string());
+
+		std::map<std::string, MeshInstances> unique;
+		{
+			LoadPhaseScope phase(kParsing);
+			collectMeshes(unique, archive.getTop());
+		}
+
+		for(auto& m : unique)
+			meshes.push_back(std::move(m.second));
+	}
+
+	// decode and triangulate the mesh data in parallel, each worker thread reading from its own archive handle.
+	// The device is held for the whole section, so that the geometries and the scene share it.
+	const Device device;
+	std::vector<Geometry> built(meshes.size());
+	{
+		tbb::enumerable_thread_specific<Alembic::Abc::IArchive> archives([&path]() {
+			LoadPhaseScope phase(kFileIO);
+			return makeFactory().getArchive(path.string());
+		});
 
-	std::vector<Mesh> meshes;
-	extractMeshes(meshes, archive.getTop());
+		tbb::parallel_for(std::size_t(0), meshes.size(), [&](std::size_t i) {
+			Alembic::Abc::IArchive& archive = archives.local();
 
+			Alembic::Abc::IObject obj;
+			{
+				LoadPhaseScope phase(kParsing);
+				obj = findObject(archive, meshes[i].path);
+			}
+
+			built[i] = makeGeometry(obj);
+		});
+	}
+
+	// attaching the geometry to scenes is not thread-safe
 	Scene result;
 
-	while(!meshes.empty()) {
-		Mesh m = std::move(meshes.back());
-		meshes.pop_back();
+	for(std::size_t i = 0; i < meshes.size(); ++i) {
+		// a single non-transformed mesh doesn't need an instance
+		if(meshes[i].transforms.size() == 1 && isIdentity(meshes[i].transforms[0]))
+			built[i].addTo(result);
 
-		result.addMesh(std::move(m));
+		// each unique mesh is loaded only once, and instanced for each of its transformations
+		else {
+			Scene item;
+			built[i].addTo(item);
+			{
+				LoadPhaseScope phase(kLevelCommit);
+				item.commit();
+			}
+
+			for(auto& tr : meshes[i].transforms)
+				result.addInstance(item, tr);
+		}
 	}
 
 	return result;
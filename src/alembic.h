@@ -4,4 +4,22 @@
 
 #include "scene.h"
 
+/// Settings of the Ogawa archive reader
+struct AlembicOptions {
+	enum ReadStrategy {
+		kFileStreams,
+		kMemoryMappedFiles
+	};
+
+	ReadStrategy readStrategy = kMemoryMappedFiles;
+	/// number of Ogawa streams per archive handle (only used with kFileStreams)
+	std::size_t numStreams = 1;
+
+	/// tessellation rate of subdivision surfaces (number of segments per control cage edge)
+	float tessellationRate = 2.0f;
+};
+
+/// Changes the settings used by all subsequent loadAlembic() calls
+void setAlembicOptions(const AlembicOptions& options);
+
 Scene loadAlembic(boost::filesystem::path path);
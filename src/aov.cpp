@@ -0,0 +1,136 @@
+#include "aov.h"
+
+#include <cmath>
+#include <limits>
+#include <string>
+#include <thread>
+#include <algorithm>
+
+#include <tbb/parallel_for.h>
+
+#include <ImfHeader.h>
+#include <ImfChannelList.h>
+#include <ImfFrameBuffer.h>
+#include <ImfOutputFile.h>
+#include <ImfThreading.h>
+
+namespace {
+
+/// number of scanlines traced as one ray stream - the same as the block size of EXR's ZIP compression
+const int s_blockHeight = 16;
+
+}
+
+Aovs renderAovs(const Scene& scene, const Camera& camera, int width, int height) {
+	Aovs result;
+	result.width = width;
+	result.height = height;
+
+	const std::size_t pixelCount = (std::size_t)width * height;
+	result.color.resize(pixelCount);
+	result.depth.resize(pixelCount);
+	result.normals.resize(pixelCount);
+	result.geomIDs.resize(pixelCount);
+	result.primIDs.resize(pixelCount);
+	result.instIDs.resize(pixelCount * RTC_MAX_INSTANCE_LEVEL_COUNT);
+
+	tbb::parallel_for(0, (height + s_blockHeight - 1) / s_blockHeight, [&](int block) {
+		const int yMin = block * s_blockHeight;
+		const int yMax = std::min(yMin + s_blockHeight, height);
+
+		std::vector<RTCRayHit> rays((std::size_t)width * (yMax - yMin));
+		for(int y = yMin; y < yMax; ++y)
+			for(int x = 0; x < width; ++x) {
+				const Ray r = camera.pixelRay(x, y, width, height);
+
+				RTCRayHit& rayhit = rays[(std::size_t)(y - yMin) * width + x];
+
+				rayhit.ray.org_x = r.origin.x;
+				rayhit.ray.org_y = r.origin.y;
+				rayhit.ray.org_z = r.origin.z;
+
+				rayhit.ray.tnear = 0;
+				rayhit.ray.tfar = std::numeric_limits<float>::infinity();
+
+				rayhit.ray.dir_x = r.direction.x;
+				rayhit.ray.dir_y = r.direction.y;
+				rayhit.ray.dir_z = r.direction.z;
+
+				rayhit.ray.time = 0;
+
+				rayhit.ray.mask = 0xFFFFFFFF;
+				rayhit.ray.id = 0;
+				rayhit.ray.flags = 0;
+
+				rayhit.hit.geomID = RTC_INVALID_GEOMETRY_ID;
+				rayhit.hit.primID = RTC_INVALID_GEOMETRY_ID;
+				for(unsigned l = 0; l < RTC_MAX_INSTANCE_LEVEL_COUNT; ++l)
+					rayhit.hit.instID[l] = RTC_INVALID_GEOMETRY_ID;
+			}
+
+		scene.intersect(rays.data(), rays.size());
+
+		std::vector<Vec3> shading(rays.size());
+		scene.worldNormals(rays.data(), rays.size(), &result.normals[(std::size_t)yMin * width], shading.data());
+
+		for(std::size_t i = 0; i < rays.size(); ++i) {
+			const RTCRayHit& rayhit = rays[i];
+			const std::size_t index = (std::size_t)yMin * width + i;
+
+			if(rayhit.hit.geomID == RTC_INVALID_GEOMETRY_ID) {
+				result.color[index] = 0.0f;
+				result.depth[index] = std::numeric_limits<float>::infinity();
+				result.primIDs[index] = RTC_INVALID_GEOMETRY_ID;
+			}
+
+			else {
+				const Vec3 dir(rayhit.ray.dir_x, rayhit.ray.dir_y, rayhit.ray.dir_z);
+
+				result.color[index] = std::abs(dir.dot(shading[i]));
+				result.depth[index] = rayhit.ray.tfar;
+				result.primIDs[index] = rayhit.hit.primID;
+			}
+
+			result.geomIDs[index] = rayhit.hit.geomID;
+			for(unsigned l = 0; l < RTC_MAX_INSTANCE_LEVEL_COUNT; ++l)
+				result.instIDs[index * RTC_MAX_INSTANCE_LEVEL_COUNT + l] = rayhit.hit.instID[l];
+		}
+	});
+
+	return result;
+}
+
+void writeExr(const Aovs& aovs, const boost::filesystem::path& path) {
+	// scanline blocks are compressed in parallel by OpenEXR's global thread pool
+	Imf::setGlobalThreadCount(std::max(std::thread::hardware_concurrency(), 1u));
+
+	Imf::Header header(aovs.width, aovs.height);
+	header.compression() = Imf::ZIP_COMPRESSION;
+
+	Imf::FrameBuffer frameBuffer;
+
+	auto addChannel = [&](const std::string& name, Imf::PixelType type, const void* data, std::size_t xStride) {
+		header.channels().insert(name, Imf::Channel(type));
+		frameBuffer.insert(name, Imf::Slice(type, (char*)data, xStride, xStride * aovs.width));
+	};
+
+	// the color is grayscale, so all three channels read the same buffer
+	for(const char* c : {"R", "G", "B"})
+		addChannel(c, Imf::FLOAT, aovs.color.data(), sizeof(float));
+
+	addChannel("Z", Imf::FLOAT, aovs.depth.data(), sizeof(float));
+
+	addChannel("N.X", Imf::FLOAT, &aovs.normals.data()->x, sizeof(Vec3));
+	addChannel("N.Y", Imf::FLOAT, &aovs.normals.data()->y, sizeof(Vec3));
+	addChannel("N.Z", Imf::FLOAT, &aovs.normals.data()->z, sizeof(Vec3));
+
+	addChannel("geomID", Imf::UINT, aovs.geomIDs.data(), sizeof(std::uint32_t));
+	addChannel("primID", Imf::UINT, aovs.primIDs.data(), sizeof(std::uint32_t));
+
+	for(unsigned l = 0; l < RTC_MAX_INSTANCE_LEVEL_COUNT; ++l)
+		addChannel("instID." + std::to_string(l), Imf::UINT, aovs.instIDs.data() + l, RTC_MAX_INSTANCE_LEVEL_COUNT * sizeof(std::uint32_t));
+
+	Imf::OutputFile file(path.string().c_str(), header);
+	file.setFrameBuffer(frameBuffer);
+	file.writePixels(aovs.height);
+}
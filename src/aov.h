@@ -0,0 +1,32 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include <boost/filesystem/path.hpp>
+
+#include "maths.h"
+#include "scene.h"
+
+/// Per-pixel outputs of an offline render - the shaded image, and the primary hit data it was computed from
+struct Aovs {
+	int width = 0, height = 0;
+
+	/// facing ratio (grayscale)
+	std::vector<float> color;
+	/// hit distance along the camera ray, infinite for pixels without a hit
+	std::vector<float> depth;
+	/// world-space geometric normal, zero for pixels without a hit
+	std::vector<Vec3> normals;
+
+	/// Embree's hit IDs, RTC_INVALID_GEOMETRY_ID for pixels without a hit. instIDs stores the whole instance stack,
+	/// RTC_MAX_INSTANCE_LEVEL_COUNT consecutive values per pixel.
+	std::vector<std::uint32_t> geomIDs, primIDs, instIDs;
+};
+
+/// Renders all the outputs of a camera view, tracing the primary rays in streams of scanline blocks
+Aovs renderAovs(const Scene& scene, const Camera& camera, int width, int height);
+
+/// Writes all outputs as channels of a single scanline EXR file (R, G, B, Z, N.X, N.Y, N.Z, geomID, primID and one
+/// instID.<level> channel per instancing level), compressed in parallel by OpenEXR's thread pool
+void writeExr(const Aovs& aovs, const boost::filesystem::path& path);
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <cassert>
+
+/// A simple non-owning view of one of Embree's geometry buffers
+template<typename T>
+class Buffer {
+	public:
+		Buffer(T* ptr = nullptr, std::size_t size = 0) : m_data(ptr), m_size(size) {
+		}
+
+		T& operator[](std::size_t index) {
+			assert(index < m_size);
+			return m_data[index];
+		}
+
+		const T& operator[](std::size_t index) const {
+			assert(index < m_size);
+			return m_data[index];
+		}
+
+		typedef T* iterator;
+		iterator begin() {
+			return m_data;
+		}
+
+		iterator end() {
+			return m_data + m_size;
+		}
+
+		typedef const T* const_iterator;
+		const_iterator begin() const {
+			return m_data;
+		}
+
+		const_iterator end() const {
+			return m_data + m_size;
+		}
+
+		std::size_t size() const {
+			return m_size;
+		}
+
+	private:
+		T* m_data;
+		std::size_t m_size;
+};
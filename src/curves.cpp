@@ -0,0 +1,88 @@
+#include "curves.h"
+
+#include <cassert>
+
+namespace {
+
+RTCGeometryType geometryType(Curves::Basis basis) {
+	switch(basis) {
+		case Curves::kLinear:
+			return RTC_GEOMETRY_TYPE_FLAT_LINEAR_CURVE;
+		case Curves::kBezier:
+			return RTC_GEOMETRY_TYPE_FLAT_BEZIER_CURVE;
+		case Curves::kBSpline:
+			return RTC_GEOMETRY_TYPE_FLAT_BSPLINE_CURVE;
+	}
+
+	assert(false);
+	return RTC_GEOMETRY_TYPE_FLAT_LINEAR_CURVE;
+}
+
+}
+
+Curves::GeometryHandle::GeometryHandle(const Device& device, Basis basis) : m_geometry(rtcNewGeometry(device, geometryType(basis))) {
+}
+
+Curves::GeometryHandle::~GeometryHandle() {
+	rtcReleaseGeometry(m_geometry);
+}
+
+Curves::GeometryHandle::operator RTCGeometry& () {
+	return m_geometry;
+}
+
+Curves::GeometryHandle::operator const RTCGeometry& () const {
+	return m_geometry;
+}
+
+///////////////////
+
+Curves::Curves(Basis basis, std::size_t vertexCount, std::size_t segmentCount) : m_basis(basis), m_geom(new GeometryHandle(m_device, basis)),
+	m_vertices((CurveVertex*)rtcSetNewGeometryBuffer(*m_geom, RTC_BUFFER_TYPE_VERTEX, 0, RTC_FORMAT_FLOAT4, sizeof(CurveVertex),
+	           vertexCount), vertexCount),
+	m_segments((unsigned*)rtcSetNewGeometryBuffer(*m_geom, RTC_BUFFER_TYPE_INDEX, 0, RTC_FORMAT_UINT, sizeof(unsigned),
+	           segmentCount), segmentCount)
+{
+}
+
+Curves::~Curves() {
+}
+
+Curves::Curves(Curves&& m) : m_device(m.m_device), m_basis(m.m_basis), m_geom(std::move(m.m_geom)), m_vertices(m.m_vertices),
+	m_segments(m.m_segments) {
+}
+
+Curves& Curves::operator=(Curves&& m) {
+	m_device = m.m_device;
+	m_basis = m.m_basis;
+	m_geom = std::move(m.m_geom);
+	m_vertices = m.m_vertices;
+	m_segments = m.m_segments;
+
+	return *this;
+}
+
+Curves::Basis Curves::basis() const {
+	return m_basis;
+}
+
+Buffer<CurveVertex>& Curves::vertices() {
+	return m_vertices;
+}
+
+const Buffer<CurveVertex>& Curves::vertices() const {
+	return m_vertices;
+}
+
+Buffer<unsigned>& Curves::segments() {
+	return m_segments;
+}
+
+const Buffer<unsigned>& Curves::segments() const {
+	return m_segments;
+}
+
+const RTCGeometry& Curves::geom() const {
+	assert(m_geom != nullptr);
+	return *m_geom;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <memory>
+
+#include <embree3/rtcore_geometry.h>
+
+#include "maths.h"
+#include "device.h"
+#include "buffer.h"
+
+/// A control vertex of a curve, with its radius
+struct CurveVertex {
+	float x, y, z, r;
+};
+
+/// A non-copyable (only movable) set of flat (ray-facing ribbon) curves, all sharing the same basis.
+/// Each curve segment is described by the index of its first control vertex; linear segments use
+/// 2 consecutive vertices, cubic segments 4.
+class Curves {
+	public:
+		enum Basis {
+			kLinear,
+			kBezier,
+			kBSpline
+		};
+
+		Curves(Basis basis, std::size_t vertexCount, std::size_t segmentCount);
+		~Curves();
+
+		Curves(const Curves& m) = delete;
+		Curves& operator=(const Curves& m) = delete;
+
+		Curves(Curves&& m);
+		Curves& operator=(Curves&& m);
+
+		Basis basis() const;
+
+		Buffer<CurveVertex>& vertices();
+		const Buffer<CurveVertex>& vertices() const;
+
+		Buffer<unsigned>& segments();
+		const Buffer<unsigned>& segments() const;
+
+		const RTCGeometry& geom() const;
+
+	private:
+		class GeometryHandle {
+			public:
+				GeometryHandle(const Device& device, Basis basis);
+				~GeometryHandle();
+
+				GeometryHandle(const GeometryHandle& m) = delete;
+				GeometryHandle& operator=(const GeometryHandle& m) = delete;
+
+				operator RTCGeometry& ();
+				operator const RTCGeometry& () const;
+
+			private:
+				RTCGeometry m_geometry;
+		};
+
+		Device m_device;
+		Basis m_basis;
+		std::unique_ptr<GeometryHandle> m_geom;
+
+		Buffer<CurveVertex> m_vertices;
+		Buffer<unsigned> m_segments;
+};
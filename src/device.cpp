@@ -1,9 +1,31 @@
 #include "device.h"
 
 #include <iostream>
+#include <atomic>
+#include <mutex>
+#include <algorithm>
+
+namespace {
+
+void error_handler(void* /*userPtr*/, const RTCError, const char* str) {
+	std::cerr << "Device error: " << str << std::endl;
+}
+
+std::atomic<ssize_t> s_memoryUsage(0);
+
+bool memory_monitor(void* /*userPtr*/, ssize_t bytes, bool /*post*/) {
+	s_memoryUsage += bytes;
+	return true;
+}
+
+}
 
 std::shared_ptr<Device::DeviceHandle> Device::sharedDevice() {
 	static std::weak_ptr<Device::DeviceHandle> s_device;
+	// geometries are created by parallel loaders, which must all get the same device
+	static std::mutex s_mutex;
+
+	std::lock_guard<std::mutex> lock(s_mutex);
 
 	std::shared_ptr<Device::DeviceHandle> dev = s_device.lock();
 	if(!dev) {
@@ -14,6 +36,19 @@ std::shared_ptr<Device::DeviceHandle> Device::sharedDevice() {
 	return dev;
 }
 
+std::string& Device::config() {
+	static std::string s_config;
+	return s_config;
+}
+
+void Device::setConfig(const std::string& config) {
+	Device::config() = config;
+}
+
+std::size_t Device::memoryUsage() {
+	return std::max(s_memoryUsage.load(), (ssize_t)0);
+}
+
 Device::Device() : m_device(sharedDevice()) {
 }
 
@@ -28,16 +63,9 @@ Device::operator const RTCDevice& () const {
 	return m_device->device;
 }
 
-namespace {
-
-void error_handler(void* /*userPtr*/, const RTCError, const char* str) {
-	std::cerr << "Device error: " << str << std::endl;
-}
-
-}
-
-Device::DeviceHandle::DeviceHandle() : device(rtcNewDevice(NULL)) {
+Device::DeviceHandle::DeviceHandle() : device(rtcNewDevice(Device::config().c_str())) {
 	rtcSetDeviceErrorFunction(device, error_handler, NULL);
+	rtcSetDeviceMemoryMonitorFunction(device, memory_monitor, NULL);
 }
 
 Device::DeviceHandle::~DeviceHandle() {
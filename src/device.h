@@ -1,6 +1,7 @@
 #pragma once
 
 #include <memory>
+#include <string>
 
 #include <boost/noncopyable.hpp>
 
@@ -16,6 +17,12 @@ class Device {
 		operator RTCDevice& ();
 		operator const RTCDevice& () const;
 
+		/// sets the configuration string passed to rtcNewDevice; only affects devices created afterwards
+		static void setConfig(const std::string& config);
+
+		/// total memory currently allocated by Embree (geometry buffers and acceleration structures), in bytes
+		static std::size_t memoryUsage();
+
 	private:
 		struct DeviceHandle : public boost::noncopyable {
 			DeviceHandle();
@@ -24,8 +31,10 @@ class Device {
 			RTCDevice device;
 		};
 
-		/// returns a shared device pointer, or instantiates a new one if none exists yet
+		/// returns a shared device pointer, or instantiates a new one if none exists yet (thread-safe)
 		static std::shared_ptr<DeviceHandle> sharedDevice();
 
+		static std::string& config();
+
 		std::shared_ptr<DeviceHandle> m_device;
 };
@@ -0,0 +1,72 @@
+#include "framebuffer.h"
+
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+namespace {
+
+/// alignment of the rows, in bytes - a cache line, and the width of the widest vector registers
+const int s_alignment = 64;
+
+}
+
+Framebuffer::Framebuffer(int w, int h) : m_pixels(nullptr), m_capacity(0), m_width(0), m_height(0), m_pitch(0) {
+	resize(w, h);
+}
+
+Framebuffer::~Framebuffer() {
+	free(m_pixels);
+}
+
+void Framebuffer::resize(int w, int h) {
+	assert(w >= 0 && h >= 0);
+
+	m_width = w;
+	m_height = h;
+	m_pitch = (w * sizeof(Uint32) + s_alignment - 1) / s_alignment * s_alignment;
+
+	const std::size_t size = (std::size_t)m_pitch * h;
+	if(size > m_capacity) {
+		free(m_pixels);
+		m_pixels = nullptr;
+		m_capacity = 0;
+
+		void* ptr = nullptr;
+		if(posix_memalign(&ptr, s_alignment, size) != 0)
+			throw std::bad_alloc();
+
+		m_pixels = (Uint32*)ptr;
+		m_capacity = size;
+	}
+}
+
+int Framebuffer::width() const {
+	return m_width;
+}
+
+int Framebuffer::height() const {
+	return m_height;
+}
+
+int Framebuffer::pitch() const {
+	return m_pitch;
+}
+
+Uint32* Framebuffer::pixels() {
+	return m_pixels;
+}
+
+const Uint32* Framebuffer::pixels() const {
+	return m_pixels;
+}
+
+void Framebuffer::copy(const Framebuffer& src, const SDL_Rect& rect) {
+	assert(src.width() == m_width && src.height() == m_height);
+	assert(rect.x >= 0 && rect.y >= 0 && rect.x + rect.w <= m_width && rect.y + rect.h <= m_height);
+
+	for(int y = rect.y; y < rect.y + rect.h; ++y)
+		memcpy(m_pixels + y * (m_pitch / sizeof(Uint32)) + rect.x, src.m_pixels + y * (src.m_pitch / sizeof(Uint32)) + rect.x,
+		       rect.w * sizeof(Uint32));
+}
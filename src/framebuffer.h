@@ -0,0 +1,31 @@
+#pragma once
+
+#include <boost/noncopyable.hpp>
+
+#include <SDL2/SDL.h>
+
+/// A 32-bit image in CPU memory, with each row aligned for vector loads and stores
+class Framebuffer : public boost::noncopyable {
+	public:
+		Framebuffer(int w = 0, int h = 0);
+		~Framebuffer();
+
+		/// changes the size of the image, keeping its memory if it is large enough (the content is undefined afterwards)
+		void resize(int w, int h);
+
+		int width() const;
+		int height() const;
+		/// size of a row in bytes
+		int pitch() const;
+
+		Uint32* pixels();
+		const Uint32* pixels() const;
+
+		/// copies a rectangle of an image of the same size
+		void copy(const Framebuffer& src, const SDL_Rect& rect);
+
+	private:
+		Uint32* m_pixels;
+		std::size_t m_capacity;
+		int m_width, m_height, m_pitch;
+};
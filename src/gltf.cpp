@@ -0,0 +1,379 @@
+#include "gltf.h"
+
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <stdexcept>
+
+#include <boost/filesystem.hpp>
+
+#include "json.hpp"
+
+#include "mesh.h"
+#include "mapped_file.h"
+#include "profiling.h"
+
+namespace {
+
+const std::uint32_t s_glbMagic = 0x46546C67; // "glTF"
+const std::uint32_t s_jsonChunk = 0x4E4F534A; // "JSON"
+const std::uint32_t s_binChunk = 0x004E4942; // "BIN\0"
+
+const int s_unsignedByte = 5121;
+const int s_unsignedShort = 5123;
+const int s_unsignedInt = 5125;
+const int s_float = 5126;
+
+const int s_triangles = 4;
+
+/// The two chunks of a .glb file, pointing into the mapped file
+struct GlbFile {
+	std::shared_ptr<MappedFile> file;
+
+	nlohmann::json json;
+
+	const char* bin = nullptr;
+	std::size_t binSize = 0;
+};
+
+/// Positions or indices copied out of the file, when they can't be referenced directly
+struct PrimitiveStorage {
+	std::shared_ptr<MappedFile> file;
+
+	std::vector<Vertex> vertices, normals;
+	std::vector<Triangle> triangles;
+};
+
+/// A typed range of the binary chunk, as described by an accessor and its buffer view
+struct Accessor {
+	const char* data;
+	std::size_t count;
+	std::size_t stride;
+	int componentType;
+	std::string type;
+};
+
+GlbFile openGlb(const boost::filesystem::path& path) {
+	GlbFile result;
+	{
+		LoadPhaseScope phase(kFileIO);
+		result.file = std::make_shared<MappedFile>(path);
+	}
+
+	const char* data = result.file->data();
+	const std::size_t size = result.file->size();
+
+	std::uint32_t header[3];
+	if(size < sizeof(header))
+		throw std::runtime_error("invalid glTF file - " + path.string());
+	memcpy(header, data, sizeof(header));
+
+	if(header[0] != s_glbMagic || header[1] != 2 || header[2] > size)
+		throw std::runtime_error("not a binary glTF 2.0 file - " + path.string());
+
+	std::size_t offset = sizeof(header);
+	while(offset + 8 <= header[2]) {
+		std::uint32_t chunk[2];
+		memcpy(chunk, data + offset, sizeof(chunk));
+		offset += sizeof(chunk);
+
+		if(offset + chunk[0] > header[2])
+			throw std::runtime_error("truncated glTF file - " + path.string());
+
+		if(chunk[1] == s_jsonChunk) {
+			LoadPhaseScope phase(kParsing);
+			result.json = nlohmann::json::parse(data + offset, data + offset + chunk[0]);
+		}
+
+		else if(chunk[1] == s_binChunk && result.bin == nullptr) {
+			result.bin = data + offset;
+			result.binSize = chunk[0];
+		}
+
+		// chunks are 4-byte aligned
+		offset += (chunk[0] + 3) / 4 * 4;
+	}
+
+	if(!result.json.is_object())
+		throw std::runtime_error("missing JSON chunk in a glTF file - " + path.string());
+
+	return result;
+}
+
+std::size_t componentCount(const std::string& type) {
+	if(type == "SCALAR")
+		return 1;
+	if(type == "VEC2")
+		return 2;
+	if(type == "VEC3")
+		return 3;
+	if(type == "VEC4")
+		return 4;
+	throw std::runtime_error("unsupported glTF accessor type - " + type);
+}
+
+std::size_t componentSize(int componentType) {
+	switch(componentType) {
+		case s_unsignedByte:
+			return 1;
+		case s_unsignedShort:
+			return 2;
+		case s_unsignedInt:
+		case s_float:
+			return 4;
+		default:
+			throw std::runtime_error("unsupported glTF component type");
+	}
+}
+
+Accessor getAccessor(const GlbFile& glb, std::size_t index) {
+	const nlohmann::json& accessor = glb.json.at("accessors").at(index);
+
+	if(accessor.count("sparse") || !accessor.count("bufferView"))
+		throw std::runtime_error("sparse glTF accessors are not supported");
+
+	const nlohmann::json& view = glb.json.at("bufferViews").at(accessor["bufferView"].get<std::size_t>());
+
+	// only the binary chunk is supported, not external or embedded (base64) buffers
+	const nlohmann::json& buffer = glb.json.at("buffers").at(view.at("buffer").get<std::size_t>());
+	if(view.at("buffer").get<std::size_t>() != 0 || buffer.count("uri") || glb.bin == nullptr)
+		throw std::runtime_error("only the binary chunk of a glTF file is supported as a buffer");
+
+	Accessor result;
+	result.count = accessor.at("count").get<std::size_t>();
+	result.componentType = accessor.at("componentType").get<int>();
+	result.type = accessor.at("type").get<std::string>();
+
+	const std::size_t elementSize = componentCount(result.type) * componentSize(result.componentType);
+	result.stride = view.count("byteStride") ? view["byteStride"].get<std::size_t>() : elementSize;
+
+	const std::size_t offset = view.value("byteOffset", (std::size_t)0) + accessor.value("byteOffset", (std::size_t)0);
+	const std::size_t length = result.count > 0 ? (result.count - 1) * result.stride + elementSize : 0;
+	if(offset + length > glb.binSize || view.value("byteOffset", (std::size_t)0) + view.at("byteLength").get<std::size_t>() > glb.binSize)
+		throw std::runtime_error("glTF accessor out of the range of its buffer");
+
+	result.data = glb.bin + offset;
+
+	return result;
+}
+
+template<typename T>
+void copyIndices(const Accessor& acc, std::vector<Triangle>& triangles) {
+	triangles.resize(acc.count / 3);
+	for(std::size_t t = 0; t < triangles.size(); ++t) {
+		T i[3];
+		for(int c = 0; c < 3; ++c)
+			memcpy(&i[c], acc.data + (t * 3 + c) * acc.stride, sizeof(T));
+
+		triangles[t] = Triangle{i[0], i[1], i[2]};
+	}
+}
+
+/// Returns a float VEC3 attribute in a form Embree can read (as a pointer and a byte stride), copying it into copy if
+/// needed - Embree reads vertex data using 16-byte loads and requires 4-byte alignment
+const float* vertexData(const GlbFile& glb, const Accessor& acc, std::vector<Vertex>& copy, std::size_t& stride) {
+	stride = acc.stride;
+
+	if(acc.count > 0 && (((std::uintptr_t)acc.data % 4) != 0 || acc.stride % 4 != 0 ||
+	                     acc.data + (acc.count - 1) * acc.stride + 16 > glb.file->end())) {
+		copy.resize(acc.count);
+		for(std::size_t v = 0; v < acc.count; ++v)
+			memcpy(&copy[v].x, acc.data + v * acc.stride, 3 * sizeof(float));
+
+		stride = sizeof(Vertex);
+		return &copy[0].x;
+	}
+
+	return (const float*)acc.data;
+}
+
+/// Makes a mesh from a triangle primitive, referencing the mapped file for the data that Embree can use directly
+Mesh makePrimitive(const GlbFile& glb, const nlohmann::json& primitive) {
+	const nlohmann::json& attributes = primitive.at("attributes");
+
+	const Accessor positions = getAccessor(glb, attributes.at("POSITION").get<std::size_t>());
+	if(positions.componentType != s_float || positions.type != "VEC3")
+		throw std::runtime_error("glTF positions have to be float VEC3");
+
+	std::shared_ptr<PrimitiveStorage> storage = std::make_shared<PrimitiveStorage>();
+	storage->file = glb.file;
+
+	std::size_t vertexStride = 0;
+	const float* vertices = vertexData(glb, positions, storage->vertices, vertexStride);
+
+	// normals are optional, and ignored if they don't match the positions
+	const float* normals = nullptr;
+	std::size_t normalStride = 0;
+	if(attributes.count("NORMAL")) {
+		const Accessor acc = getAccessor(glb, attributes["NORMAL"].get<std::size_t>());
+		if(acc.componentType == s_float && acc.type == "VEC3" && acc.count == positions.count)
+			normals = vertexData(glb, acc, storage->normals, normalStride);
+	}
+
+	const unsigned* indices = nullptr;
+	std::size_t triangleCount = 0;
+
+	if(primitive.count("indices")) {
+		const Accessor acc = getAccessor(glb, primitive["indices"].get<std::size_t>());
+		if(acc.type != "SCALAR")
+			throw std::runtime_error("glTF indices have to be scalars");
+
+		// tightly packed 32-bit indices can be used as they are
+		if(acc.componentType == s_unsignedInt && acc.stride == 4 && ((std::uintptr_t)acc.data % 4) == 0) {
+			indices = (const unsigned*)acc.data;
+			triangleCount = acc.count / 3;
+		}
+
+		else {
+			if(acc.componentType == s_unsignedInt)
+				copyIndices<std::uint32_t>(acc, storage->triangles);
+			else if(acc.componentType == s_unsignedShort)
+				copyIndices<std::uint16_t>(acc, storage->triangles);
+			else if(acc.componentType == s_unsignedByte)
+				copyIndices<std::uint8_t>(acc, storage->triangles);
+			else
+				throw std::runtime_error("unsupported glTF index type");
+		}
+	}
+
+	// non-indexed geometry - consecutive triples of vertices
+	else {
+		storage->triangles.resize(positions.count / 3);
+		for(std::size_t t = 0; t < storage->triangles.size(); ++t)
+			storage->triangles[t] = Triangle{(unsigned)(t * 3), (unsigned)(t * 3 + 1), (unsigned)(t * 3 + 2)};
+	}
+
+	if(indices == nullptr) {
+		indices = &storage->triangles.data()->v0;
+		triangleCount = storage->triangles.size();
+	}
+
+	// Embree doesn't check the indices
+	for(std::size_t i = 0; i < triangleCount * 3; ++i)
+		if(indices[i] >= positions.count)
+			throw std::runtime_error("glTF vertex index out of range");
+
+	return Mesh(storage, vertices, positions.count, vertexStride, indices, triangleCount, 3 * sizeof(unsigned), normals, normalStride);
+}
+
+/// Local transformation of a node, either as a column-major matrix or as translation * rotation * scale
+Mat4 nodeTransform(const nlohmann::json& node) {
+	Mat4 result;
+
+	if(node.count("matrix")) {
+		const nlohmann::json& m = node["matrix"];
+		for(std::size_t i = 0; i < 16; ++i)
+			result.m[i] = m.at(i).get<float>();
+	}
+
+	else {
+		const std::vector<float> t = node.value("translation", std::vector<float>{0, 0, 0});
+		const std::vector<float> r = node.value("rotation", std::vector<float>{0, 0, 0, 1});
+		const std::vector<float> s = node.value("scale", std::vector<float>{1, 1, 1});
+		if(t.size() != 3 || r.size() != 4 || s.size() != 3)
+			throw std::runtime_error("invalid glTF node transformation");
+
+		const float x = r[0], y = r[1], z = r[2], w = r[3];
+
+		// rotation matrix of a unit quaternion, with columns scaled
+		result[0][0] = (1.0f - 2.0f * (y * y + z * z)) * s[0];
+		result[0][1] = (2.0f * (x * y + z * w)) * s[0];
+		result[0][2] = (2.0f * (x * z - y * w)) * s[0];
+
+		result[1][0] = (2.0f * (x * y - z * w)) * s[1];
+		result[1][1] = (1.0f - 2.0f * (x * x + z * z)) * s[1];
+		result[1][2] = (2.0f * (y * z + x * w)) * s[1];
+
+		result[2][0] = (2.0f * (x * z + y * w)) * s[2];
+		result[2][1] = (2.0f * (y * z - x * w)) * s[2];
+		result[2][2] = (1.0f - 2.0f * (x * x + y * y)) * s[2];
+
+		result[3][0] = t[0];
+		result[3][1] = t[1];
+		result[3][2] = t[2];
+	}
+
+	return result;
+}
+
+class GltfLoader {
+	public:
+		GltfLoader(const GlbFile& glb) : m_glb(glb) {
+		}
+
+		void addNode(Scene& scene, std::size_t index, const Mat4& parentTransform, std::size_t depth = 0) {
+			// glTF node hierarchies have to be acyclic, but a malformed file shouldn't recurse forever
+			if(depth > m_glb.json.at("nodes").size())
+				throw std::runtime_error("cyclic glTF node hierarchy");
+
+			const nlohmann::json& node = m_glb.json.at("nodes").at(index);
+			const Mat4 transform = nodeTransform(node) * parentTransform;
+
+			if(node.count("mesh"))
+				scene.addInstance(mesh(node["mesh"].get<std::size_t>()), transform);
+
+			if(node.count("children"))
+				for(auto& c : node["children"])
+					addNode(scene, c.get<std::size_t>(), transform, depth + 1);
+		}
+
+	private:
+		/// each mesh is loaded once, as a separate scene, and instanced by all the nodes referencing it
+		const Scene& mesh(std::size_t index) {
+			auto it = m_meshes.find(index);
+			if(it != m_meshes.end())
+				return *it->second;
+
+			std::unique_ptr<Scene> scene(new Scene());
+
+			for(auto& primitive : m_glb.json.at("meshes").at(index).at("primitives"))
+				if(primitive.value("mode", s_triangles) == s_triangles)
+					scene->addMesh(makePrimitive(m_glb, primitive));
+
+			{
+				LoadPhaseScope phase(kLevelCommit);
+				scene->commit();
+			}
+
+			return *m_meshes.insert(std::make_pair(index, std::move(scene))).first->second;
+		}
+
+		const GlbFile& m_glb;
+		std::map<std::size_t, std::unique_ptr<Scene>> m_meshes;
+};
+
+}
+
+Scene loadGltf(boost::filesystem::path path) {
+	TraceScope scope("loadGltf");
+
+	const GlbFile glb = openGlb(path);
+
+	Scene result;
+	GltfLoader loader(glb);
+
+	// root nodes of the default scene (or of the first one, if no default is specified)
+	if(glb.json.count("scenes") && !glb.json["scenes"].empty()) {
+		const nlohmann::json& scene = glb.json["scenes"].at(glb.json.value("scene", (std::size_t)0));
+		if(scene.count("nodes"))
+			for(auto& n : scene["nodes"])
+				loader.addNode(result, n.get<std::size_t>(), Mat4());
+	}
+
+	// a file without scenes - all nodes that are not children of other nodes
+	else if(glb.json.count("nodes")) {
+		const nlohmann::json& nodes = glb.json["nodes"];
+
+		std::vector<bool> isChild(nodes.size(), false);
+		for(auto& n : nodes)
+			if(n.count("children"))
+				for(auto& c : n["children"])
+					isChild.at(c.get<std::size_t>()) = true;
+
+		for(std::size_t n = 0; n < nodes.size(); ++n)
+			if(!isChild[n])
+				loader.addNode(result, n, Mat4());
+	}
+
+	return result;
+}
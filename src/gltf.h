@@ -0,0 +1,9 @@
+#pragma once
+
+#include <boost/filesystem/path.hpp>
+
+#include "scene.h"
+
+/// Loads a binary glTF 2.0 file (.glb). Triangle primitives of each mesh are referenced directly from the
+/// memory-mapped file where their layout allows it, and each mesh node becomes an instance.
+Scene loadGltf(boost::filesystem::path path);
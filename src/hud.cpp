@@ -0,0 +1,112 @@
+#include "hud.h"
+
+#include <algorithm>
+
+namespace {
+
+/// the classic 5x7 font of character LCDs, for ASCII 32-126 - 5 columns per character, with the top row in the lowest bit
+const Uint8 s_font[95][5] = {
+	{0x00, 0x00, 0x00, 0x00, 0x00}, {0x00, 0x00, 0x5F, 0x00, 0x00}, {0x00, 0x07, 0x00, 0x07, 0x00}, {0x14, 0x7F, 0x14, 0x7F, 0x14},
+	{0x24, 0x2A, 0x7F, 0x2A, 0x12}, {0x23, 0x13, 0x08, 0x64, 0x62}, {0x36, 0x49, 0x55, 0x22, 0x50}, {0x00, 0x05, 0x03, 0x00, 0x00},
+	{0x00, 0x1C, 0x22, 0x41, 0x00}, {0x00, 0x41, 0x22, 0x1C, 0x00}, {0x08, 0x2A, 0x1C, 0x2A, 0x08}, {0x08, 0x08, 0x3E, 0x08, 0x08},
+	{0x00, 0x50, 0x30, 0x00, 0x00}, {0x08, 0x08, 0x08, 0x08, 0x08}, {0x00, 0x60, 0x60, 0x00, 0x00}, {0x20, 0x10, 0x08, 0x04, 0x02},
+	{0x3E, 0x51, 0x49, 0x45, 0x3E}, {0x00, 0x42, 0x7F, 0x40, 0x00}, {0x42, 0x61, 0x51, 0x49, 0x46}, {0x21, 0x41, 0x45, 0x4B, 0x31},
+	{0x18, 0x14, 0x12, 0x7F, 0x10}, {0x27, 0x45, 0x45, 0x45, 0x39}, {0x3C, 0x4A, 0x49, 0x49, 0x30}, {0x01, 0x71, 0x09, 0x05, 0x03},
+	{0x36, 0x49, 0x49, 0x49, 0x36}, {0x06, 0x49, 0x49, 0x29, 0x1E}, {0x00, 0x36, 0x36, 0x00, 0x00}, {0x00, 0x56, 0x36, 0x00, 0x00},
+	{0x08, 0x14, 0x22, 0x41, 0x00}, {0x14, 0x14, 0x14, 0x14, 0x14}, {0x00, 0x41, 0x22, 0x14, 0x08}, {0x02, 0x01, 0x51, 0x09, 0x06},
+	{0x32, 0x49, 0x79, 0x41, 0x3E}, {0x7E, 0x11, 0x11, 0x11, 0x7E}, {0x7F, 0x49, 0x49, 0x49, 0x36}, {0x3E, 0x41, 0x41, 0x41, 0x22},
+	{0x7F, 0x41, 0x41, 0x22, 0x1C}, {0x7F, 0x49, 0x49, 0x49, 0x41}, {0x7F, 0x09, 0x09, 0x09, 0x01}, {0x3E, 0x41, 0x49, 0x49, 0x7A},
+	{0x7F, 0x08, 0x08, 0x08, 0x7F}, {0x00, 0x41, 0x7F, 0x41, 0x00}, {0x20, 0x40, 0x41, 0x3F, 0x01}, {0x7F, 0x08, 0x14, 0x22, 0x41},
+	{0x7F, 0x40, 0x40, 0x40, 0x40}, {0x7F, 0x02, 0x0C, 0x02, 0x7F}, {0x7F, 0x04, 0x08, 0x10, 0x7F}, {0x3E, 0x41, 0x41, 0x41, 0x3E},
+	{0x7F, 0x09, 0x09, 0x09, 0x06}, {0x3E, 0x41, 0x51, 0x21, 0x5E}, {0x7F, 0x09, 0x19, 0x29, 0x46}, {0x46, 0x49, 0x49, 0x49, 0x31},
+	{0x01, 0x01, 0x7F, 0x01, 0x01}, {0x3F, 0x40, 0x40, 0x40, 0x3F}, {0x1F, 0x20, 0x40, 0x20, 0x1F}, {0x3F, 0x40, 0x38, 0x40, 0x3F},
+	{0x63, 0x14, 0x08, 0x14, 0x63}, {0x07, 0x08, 0x70, 0x08, 0x07}, {0x61, 0x51, 0x49, 0x45, 0x43}, {0x00, 0x7F, 0x41, 0x41, 0x00},
+	{0x02, 0x04, 0x08, 0x10, 0x20}, {0x00, 0x41, 0x41, 0x7F, 0x00}, {0x04, 0x02, 0x01, 0x02, 0x04}, {0x40, 0x40, 0x40, 0x40, 0x40},
+	{0x00, 0x01, 0x02, 0x04, 0x00}, {0x20, 0x54, 0x54, 0x54, 0x78}, {0x7F, 0x48, 0x44, 0x44, 0x38}, {0x38, 0x44, 0x44, 0x44, 0x20},
+	{0x38, 0x44, 0x44, 0x48, 0x7F}, {0x38, 0x54, 0x54, 0x54, 0x18}, {0x08, 0x7E, 0x09, 0x01, 0x02}, {0x0C, 0x52, 0x52, 0x52, 0x3E},
+	{0x7F, 0x08, 0x04, 0x04, 0x78}, {0x00, 0x44, 0x7D, 0x40, 0x00}, {0x20, 0x40, 0x44, 0x3D, 0x00}, {0x7F, 0x10, 0x28, 0x44, 0x00},
+	{0x00, 0x41, 0x7F, 0x40, 0x00}, {0x7C, 0x04, 0x18, 0x04, 0x78}, {0x7C, 0x08, 0x04, 0x04, 0x78}, {0x38, 0x44, 0x44, 0x44, 0x38},
+	{0x7C, 0x14, 0x14, 0x14, 0x08}, {0x08, 0x14, 0x14, 0x18, 0x7C}, {0x7C, 0x08, 0x04, 0x04, 0x08}, {0x48, 0x54, 0x54, 0x54, 0x20},
+	{0x04, 0x3F, 0x44, 0x40, 0x20}, {0x3C, 0x40, 0x40, 0x20, 0x7C}, {0x1C, 0x20, 0x40, 0x20, 0x1C}, {0x3C, 0x40, 0x30, 0x40, 0x3C},
+	{0x44, 0x28, 0x10, 0x28, 0x44}, {0x0C, 0x50, 0x50, 0x50, 0x3C}, {0x44, 0x64, 0x54, 0x4C, 0x44}, {0x00, 0x08, 0x36, 0x41, 0x00},
+	{0x00, 0x00, 0x7F, 0x00, 0x00}, {0x00, 0x41, 0x36, 0x08, 0x00}, {0x08, 0x04, 0x08, 0x10, 0x08},
+};
+
+/// each font pixel is drawn as a block of s_scale x s_scale pixels
+const int s_scale = 2;
+/// size of a character cell, including the spacing, in font pixels
+const int s_cellWidth = 6;
+const int s_cellHeight = 9;
+/// border around the text, in pixels
+const int s_margin = 4;
+/// distance of the overlay from the top-left window corner, in pixels
+const int s_offset = 8;
+
+/// colors in SDL_PIXELFORMAT_ARGB8888
+const Uint32 s_background = 0xB0000000;
+const Uint32 s_foreground = 0xFFFFFFFF;
+
+}
+
+Hud::Hud(SDL_Renderer* renderer) : m_renderer(renderer), m_visible(false) {
+}
+
+void Hud::setVisible(bool visible) {
+	m_visible = visible;
+}
+
+bool Hud::visible() const {
+	return m_visible;
+}
+
+void Hud::setText(const std::vector<std::string>& lines) {
+	std::size_t columns = 0;
+	for(auto& l : lines)
+		columns = std::max(columns, l.size());
+
+	const int w = columns * s_cellWidth * s_scale + 2 * s_margin;
+	const int h = lines.size() * s_cellHeight * s_scale + 2 * s_margin;
+	m_image.resize(w, h);
+
+	const int stride = m_image.pitch() / sizeof(Uint32);
+	Uint32* pixels = m_image.pixels();
+
+	for(int y = 0; y < h; ++y)
+		std::fill(pixels + y * stride, pixels + y * stride + w, s_background);
+
+	for(std::size_t row = 0; row < lines.size(); ++row)
+		for(std::size_t col = 0; col < lines[row].size(); ++col) {
+			const unsigned char c = lines[row][col];
+			if(c < 32 || c > 126)
+				continue;
+
+			const int x0 = s_margin + col * s_cellWidth * s_scale;
+			const int y0 = s_margin + row * s_cellHeight * s_scale;
+
+			for(int gx = 0; gx < 5; ++gx)
+				for(int gy = 0; gy < 7; ++gy)
+					if(s_font[c - 32][gx] & (1 << gy))
+						for(int y = 0; y < s_scale; ++y)
+							std::fill_n(pixels + (y0 + gy * s_scale + y) * stride + x0 + gx * s_scale, s_scale, s_foreground);
+		}
+
+	if(m_texture.get() == nullptr || m_texture->width() < w || m_texture->height() < h) {
+		m_texture = std::unique_ptr<Texture>(new Texture(m_renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING,
+		                                                 std::max(w, 1), std::max(h, 1)));
+		SDL_SetTextureBlendMode(m_texture->texture(), SDL_BLENDMODE_BLEND);
+	}
+
+	if(w > 0 && h > 0) {
+		const SDL_Rect rect{0, 0, w, h};
+		SDL_UpdateTexture(m_texture->texture(), &rect, pixels, m_image.pitch());
+	}
+}
+
+void Hud::draw() {
+	if(!m_visible || m_texture.get() == nullptr)
+		return;
+
+	const SDL_Rect src{0, 0, m_image.width(), m_image.height()};
+	const SDL_Rect dest{s_offset, s_offset, m_image.width(), m_image.height()};
+	SDL_RenderCopy(m_renderer, m_texture->texture(), &src, &dest);
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+
+#include <boost/noncopyable.hpp>
+
+#include <SDL2/SDL.h>
+
+#include "texture.h"
+#include "framebuffer.h"
+
+/// A text overlay shown over the rendered image (e.g., performance counters), rasterized on the CPU with a built-in
+/// 5x7 bitmap font. Main thread only.
+class Hud : public boost::noncopyable {
+	public:
+		Hud(SDL_Renderer* renderer);
+
+		void setVisible(bool visible);
+		bool visible() const;
+
+		/// replaces the text (one string per line) - only printable ASCII characters are drawn
+		void setText(const std::vector<std::string>& lines);
+
+		/// draws the overlay over the current render target, if it is visible
+		void draw();
+
+	private:
+		SDL_Renderer* m_renderer;
+
+		/// the rasterized text, and the texture it is uploaded to (recreated only when it needs to grow)
+		Framebuffer m_image;
+		std::unique_ptr<Texture> m_texture;
+
+		bool m_visible;
+};
@@ -3,12 +3,18 @@
 #include <fstream>
 #include <thread>
 #include <functional>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <limits>
 
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_render.h>
 
 #include <boost/program_options.hpp>
 #include <boost/filesystem.hpp>
+#include <boost/algorithm/string/split.hpp>
+#include <boost/algorithm/string/classification.hpp>
 
 #include "json.hpp"
 
@@ -18,9 +24,60 @@
 #include "renderer.h"
 
 #include "scene_loading.h"
+#include "alembic.h"
+#include "mesh_cache.h"
+#include "aov.h"
+#include "hud.h"
+#include "profiling.h"
 
 #define SCREEN_SIZE	512
 
+namespace {
+
+/// the longest time the main loop waits for an event (ms), as a safety net - the renderer wakes it up when an image is ready
+const int s_waitTimeout = 500;
+
+/// the shortest time between two camera or light updates (ms) - the motion of all events in between is coalesced
+const Uint32 s_updateInterval = 16;
+
+/// refresh interval of the HUD (ms), while the image doesn't change
+const Uint32 s_hudInterval = 250;
+
+/// printf-style formatting of a line of the HUD
+template<typename... ARGS>
+std::string format(const char* fmt, ARGS... args) {
+	char buffer[256];
+	snprintf(buffer, sizeof(buffer), fmt, args...);
+	return buffer;
+}
+
+/// the performance counters shown in the HUD
+std::vector<std::string> hudText(const Renderer& renderer, const Scene& scene, Uint32 sinceCameraChange) {
+	static const char* s_modeNames[] = {"facing ratio", "ambient occlusion", "directional light", "path tracing"};
+
+	const Renderer::Statistics stats = renderer.statistics();
+
+	std::vector<std::string> result;
+	result.push_back(format("mode: %s", s_modeNames[renderer.mode()]));
+	result.push_back(format("level: %d/%d, pass %d", renderer.currentTexture() + 1, (int)stats.levelTimes.size(), renderer.currentPass()));
+
+	std::string levels = "levels (ms):";
+	for(float t : stats.levelTimes)
+		if(t > 0.0f)
+			levels += format(" %.1f", t);
+	result.push_back(levels);
+
+	result.push_back(format("pass: %.1f ms, reprojection: %.1f ms", stats.passTime, stats.reprojectionTime));
+	result.push_back(format("rays: %.2f Mrays/s, threads: %d active of %d", stats.raysPerSecond * 1e-6, stats.activeThreads, stats.threads));
+	result.push_back(format("embree memory: %.1f MB", (double)Device::memoryUsage() / (1024.0 * 1024.0)));
+	result.push_back(format("primitives: %zu, instances: %zu", scene.statistics().primitives, scene.statistics().instances));
+	result.push_back(format("camera changed %.1f s ago", (double)sinceCameraChange * 1e-3));
+
+	return result;
+}
+
+}
+
 namespace po = boost::program_options;
 
 int main(int argc, char* argv[]) {
@@ -28,8 +85,25 @@ int main(int argc, char* argv[]) {
 
 	desc.add_options()
 	("help", "produce help message")
-	("mesh", po::value<std::string>(), "load mesh file (.abc, .obj)")
+	("mesh", po::value<std::string>(), "load mesh file (.abc, .obj, .glb)")
 	("scene", po::value<std::string>(), "load a scene file (.json)")
+	("strip-curves", po::value<std::string>(), "convert quad strips of a --mesh file to curves (linear, bezier)")
+	("abc-read-strategy", po::value<std::string>()->default_value("mmap"), "Alembic Ogawa read strategy (mmap, streams)")
+	("abc-streams", po::value<std::size_t>()->default_value(1), "number of Ogawa streams per Alembic archive handle")
+	("subdiv-rate", po::value<float>()->default_value(2.0f), "tessellation rate of subdivision surfaces (segments per edge)")
+	("tessellation-cache", po::value<std::size_t>(), "size of Embree's tessellation cache (MB)")
+	("mesh-cache", po::value<std::string>(), "directory of the binary .obj mesh cache (default: next to each .obj file)")
+	("no-mesh-cache", "disable the binary .obj mesh cache")
+	("render-mode", po::value<std::string>()->default_value("facing"), "initial render mode (facing, ao, light, path)")
+	("ao-samples", po::value<unsigned>()->default_value(4), "ambient occlusion rays per pixel in each pass")
+	("ao-passes", po::value<unsigned>()->default_value(64), "number of accumulated ambient occlusion passes")
+	("ao-distance", po::value<float>()->default_value(0.0f), "maximum ambient occlusion distance (0 = 10% of the scene size)")
+	("pt-bounces", po::value<unsigned>()->default_value(4), "maximum number of path tracing bounces")
+	("pt-passes", po::value<unsigned>()->default_value(256), "number of accumulated path tracing passes")
+	("camera", po::value<std::string>(), "initial camera position and target (px,py,pz,tx,ty,tz)")
+	("output", po::value<std::string>(), "render to an EXR file with AOV layers instead of opening a window")
+	("resolution", po::value<std::string>()->default_value("1920x1080"), "resolution of the --output image")
+	("trace", po::value<std::string>(), "record a timeline of loading and rendering, written on exit in the Chrome Trace Event format")
 	;
 
 	po::variables_map vm;
@@ -41,6 +115,103 @@ int main(int argc, char* argv[]) {
 		return 1;
 	}
 
+	if(vm.count("trace")) {
+		startTrace();
+		setTraceThreadName("main");
+	}
+
+	{
+		AlembicOptions abcOptions;
+
+		const std::string strategy = vm["abc-read-strategy"].as<std::string>();
+		if(strategy == "streams")
+			abcOptions.readStrategy = AlembicOptions::kFileStreams;
+		else if(strategy == "mmap")
+			abcOptions.readStrategy = AlembicOptions::kMemoryMappedFiles;
+		else
+			throw std::runtime_error("unknown Alembic read strategy - " + strategy);
+
+		abcOptions.numStreams = vm["abc-streams"].as<std::size_t>();
+		abcOptions.tessellationRate = vm["subdiv-rate"].as<float>();
+
+		setAlembicOptions(abcOptions);
+	}
+
+	{
+		MeshCacheOptions cacheOptions;
+
+		cacheOptions.enabled = !vm.count("no-mesh-cache");
+		if(vm.count("mesh-cache"))
+			cacheOptions.directory = vm["mesh-cache"].as<std::string>();
+
+		setMeshCacheOptions(cacheOptions);
+	}
+
+	if(vm.count("tessellation-cache"))
+		Device::setConfig("tessellation_cache_size=" + std::to_string(vm["tessellation-cache"].as<std::size_t>()));
+
+	// make the scene
+	Scene scene;
+	if(vm.count("mesh")) {
+		StripCurves strips = kNoStripCurves;
+		if(vm.count("strip-curves")) {
+			const std::string type = vm["strip-curves"].as<std::string>();
+			if(type == "linear")
+				strips = kLinearStripCurves;
+			else if(type == "bezier")
+				strips = kBezierStripCurves;
+			else
+				throw std::runtime_error("unknown curves type - " + type);
+		}
+
+		scene = loadMesh(vm["mesh"].as<std::string>(), strips);
+	}
+
+	else if(vm.count("scene")) {
+		nlohmann::json source;
+		{
+			std::ifstream file(vm["scene"].as<std::string>());
+			file >> source;
+		}
+		assert(source.is_array());
+
+		const boost::filesystem::path scene_root = boost::filesystem::path(vm["scene"].as<std::string>()).parent_path();
+
+		scene = parseScene(source, scene_root);
+	}
+
+	else {
+		Mesh m = Mesh::makeSphere(Vec3{0, 0, 0}, 100);
+		scene.addMesh(std::move(m));
+	}
+
+	scene.commit();
+
+	Camera cam;
+	if(vm.count("camera")) {
+		std::vector<std::string> values;
+		boost::split(values, vm["camera"].as<std::string>(), boost::is_any_of(","));
+		if(values.size() != 6)
+			throw std::runtime_error("camera has to be specified as px,py,pz,tx,ty,tz");
+
+		cam.position = Vec3(std::stof(values[0]), std::stof(values[1]), std::stof(values[2]));
+		cam.target = Vec3(std::stof(values[3]), std::stof(values[4]), std::stof(values[5]));
+	}
+
+	// offline rendering, without opening a window
+	if(vm.count("output")) {
+		int width = 0, height = 0;
+		if(sscanf(vm["resolution"].as<std::string>().c_str(), "%dx%d", &width, &height) != 2 || width <= 0 || height <= 0)
+			throw std::runtime_error("resolution has to be specified as WIDTHxHEIGHT");
+
+		writeExr(renderAovs(scene, cam, width, height), vm["output"].as<std::string>());
+
+		if(vm.count("trace"))
+			writeTrace(vm["trace"].as<std::string>());
+
+		return 0;
+	}
+
 	// SDL initialisation
 	if(SDL_Init(SDL_INIT_VIDEO))
 		throw std::runtime_error(SDL_GetError());
@@ -58,50 +229,64 @@ int main(int argc, char* argv[]) {
 		throw std::runtime_error(SDL_GetError());
 
 	{
-		// make the scene
-		Scene scene;
-		if(vm.count("mesh"))
-			scene = loadMesh(vm["mesh"].as<std::string>());
-
-		else if(vm.count("scene")) {
-			nlohmann::json source;
-			{
-				std::ifstream file(vm["scene"].as<std::string>());
-				file >> source;
-			}
-			assert(source.is_array());
-
-			const boost::filesystem::path scene_root = boost::filesystem::path(vm["scene"].as<std::string>()).parent_path();
-
-			scene = parseScene(source, scene_root);
-		}
+		Renderer renderer(scene, screen, sdlRenderer);
 
-		else {
-			Mesh m = Mesh::makeSphere(Vec3{0, 0, 0}, 100);
-			scene.addMesh(std::move(m));
+		{
+			Renderer::AmbientOcclusion ao;
+			ao.samples = vm["ao-samples"].as<unsigned>();
+			ao.passes = vm["ao-passes"].as<unsigned>();
+			ao.distance = vm["ao-distance"].as<float>();
+			renderer.setAmbientOcclusion(ao);
+
+			Renderer::PathTracing pt;
+			pt.bounces = vm["pt-bounces"].as<unsigned>();
+			pt.passes = vm["pt-passes"].as<unsigned>();
+			renderer.setPathTracing(pt);
+
+			const std::string mode = vm["render-mode"].as<std::string>();
+			if(mode == "ao")
+				renderer.setMode(Renderer::kAmbientOcclusion);
+			else if(mode == "light")
+				renderer.setMode(Renderer::kDirectionalLight);
+			else if(mode == "path")
+				renderer.setMode(Renderer::kPathTracing);
+			else if(mode != "facing")
+				throw std::runtime_error("unknown render mode - " + mode);
 		}
 
-		scene.commit();
+		renderer.setCamera(cam);
 
-		///////////////////////////
+		// direction towards the light, in spherical coordinates
+		float lightAzimuth = std::atan2(renderer.light().z, renderer.light().x);
+		float lightElevation = std::asin(renderer.light().y);
 
-		Renderer renderer(scene, screen, sdlRenderer);
+		// camera and light changes not applied to the renderer yet
+		bool cameraChanged = false, lightChanged = false;
+		Uint32 lastUpdate = 0;
 
-		Camera cam;
-		renderer.setCamera(cam);
+		// performance counters, toggled by the h key
+		Hud hud(sdlRenderer);
+		Uint32 lastCameraChange = SDL_GetTicks(), lastHud = 0;
+		bool redraw = false;
 
 		// the main loop
-		int currentTexture = 0;
-
 		bool quit = false;
 
 		while(!quit) {
 			/////////////////////
 			// EVENT LOOP
 			/////////////////////
-			{
-				SDL_Event event;
-				while(SDL_PollEvent(&event)) {
+			// blocks until there is an input event, or the renderer posts its readyEvent() with a new image to show -
+			// all pending events are then processed before presenting
+			int timeout = s_waitTimeout;
+			if(cameraChanged || lightChanged)
+				timeout = std::max((int)s_updateInterval - (int)(SDL_GetTicks() - lastUpdate), 0);
+			if(hud.visible())
+				timeout = std::min(timeout, std::max((int)s_hudInterval - (int)(SDL_GetTicks() - lastHud), 0));
+
+			SDL_Event event;
+			if(SDL_WaitEventTimeout(&event, timeout)) {
+				do {
 					int w, h;
 					SDL_GetWindowSize(screen, &w, &h);
 
@@ -109,17 +294,41 @@ int main(int argc, char* argv[]) {
 					if(event.type == SDL_QUIT || (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_ESCAPE))
 						quit = true;
 
+					// switching between facing ratio and ambient occlusion / directional light / path tracing
+					else if(event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_a) {
+						renderer.setMode(renderer.mode() == Renderer::kAmbientOcclusion ? Renderer::kFacingRatio : Renderer::kAmbientOcclusion);
+					}
+
+					else if(event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_l) {
+						renderer.setMode(renderer.mode() == Renderer::kDirectionalLight ? Renderer::kFacingRatio : Renderer::kDirectionalLight);
+					}
+
+					else if(event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_p) {
+						renderer.setMode(renderer.mode() == Renderer::kPathTracing ? Renderer::kFacingRatio : Renderer::kPathTracing);
+					}
+
+					else if(event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_h) {
+						hud.setVisible(!hud.visible());
+						redraw = true;
+					}
+
 					// camera motion
 					else if(event.type == SDL_MOUSEMOTION) {
-						if(event.motion.state & SDL_BUTTON_LMASK) {
+						// light motion - only the shadows are retraced
+						if((event.motion.state & SDL_BUTTON_LMASK) && (SDL_GetModState() & KMOD_SHIFT)) {
+							lightAzimuth += ((float)(event.motion.xrel) / (float)w) * M_PI;
+							lightElevation = std::max(std::min(lightElevation - ((float)(event.motion.yrel) / (float)h) * (float)M_PI, (float)M_PI / 2.0f), 0.0f);
+
+							lightChanged = true;
+						}
+
+						else if(event.motion.state & SDL_BUTTON_LMASK) {
 							const float xangle = ((float)(event.motion.xrel) / (float)w) * M_PI;
 							const float yangle = ((float)(event.motion.yrel) / (float)h) * M_PI;
 
 							cam.rotate(xangle, -yangle);
 
-							renderer.setCamera(cam);
-
-							currentTexture = -1;
+							cameraChanged = true;
 						}
 
 						else if(event.motion.state & SDL_BUTTON_RMASK) {
@@ -133,55 +342,78 @@ int main(int argc, char* argv[]) {
 
 							cam.position = cam.target - tr * dist;
 
-							renderer.setCamera(cam);
-
-							currentTexture = -1;
+							cameraChanged = true;
 						}
 					}
 
 					else if(event.type == SDL_MOUSEBUTTONDOWN && event.button.clicks == 2) {
-						RTCRayHit hit = scene.trace(renderer.cameraRay(event.button.x, event.button.y, w, h));
-
-						Vec3 target{
-							hit.ray.org_x + hit.ray.dir_x * hit.ray.tfar,
-							hit.ray.org_y + hit.ray.dir_y * hit.ray.tfar,
-							hit.ray.org_z + hit.ray.dir_z * hit.ray.tfar,
-						};
+						const Ray ray = cam.pixelRay(event.button.x, event.button.y, w, h);
 
-						cam.target = target;
+						// the ID buffer of the renderer answers without tracing, unless it is not up to date with the camera
+						float distance;
+						Renderer::Hit hit;
+						if(renderer.pick(cam, event.button.x, event.button.y, w, h, hit))
+							distance = hit.distance;
+						else
+							distance = scene.trace(ray).ray.tfar;
 
-						renderer.setCamera(cam);
+						if(distance < std::numeric_limits<float>::infinity()) {
+							cam.target = ray.origin + ray.direction * distance;
 
-						currentTexture = -1;
+							cameraChanged = true;
+						}
 					}
 
 					// window resizing
 					else if(event.type == SDL_WINDOWEVENT) {
 						if(event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED) {
 							renderer.resize(event.window.data1 / 4, event.window.data2 / 4);
-
-							currentTexture = -1;
 						}
 					}
+				} while(SDL_PollEvent(&event));
+			}
+
+			// each update restarts the rendering, so all the motion since the last one is applied at once
+			if((cameraChanged || lightChanged) && SDL_GetTicks() - lastUpdate >= s_updateInterval) {
+				if(lightChanged)
+					renderer.setLight(Vec3(
+						std::cos(lightAzimuth) * std::cos(lightElevation),
+						std::sin(lightElevation),
+						std::sin(lightAzimuth) * std::cos(lightElevation)));
+
+				if(cameraChanged) {
+					renderer.setCamera(cam);
+					lastCameraChange = SDL_GetTicks();
 				}
+
+				cameraChanged = false;
+				lightChanged = false;
+				lastUpdate = SDL_GetTicks();
 			}
 
 			/////////////////////
 			// RENDERING
 			/////////////////////
-			{
-				const int textureId = renderer.currentTexture();
-				if(currentTexture != textureId && textureId >= 0) {
-					// show the result by flipping the double buffer
-					SDL_RenderCopy(sdlRenderer, renderer.texture(), NULL, NULL);
+			// uploads the latest image published by the render thread
+			if(renderer.update())
+				redraw = true;
+
+			// the HUD text is updated with each new image, and periodically in between
+			if(hud.visible() && (redraw || SDL_GetTicks() - lastHud >= s_hudInterval)) {
+				hud.setText(hudText(renderer, scene, SDL_GetTicks() - lastCameraChange));
+				lastHud = SDL_GetTicks();
+				redraw = true;
+			}
 
-					SDL_RenderPresent(sdlRenderer);
+			if(redraw && renderer.currentTexture() >= 0) {
+				// show the result by flipping the double buffer
+				SDL_RenderCopy(sdlRenderer, renderer.texture(), NULL, NULL);
+				hud.draw();
 
-					currentTexture = textureId;
-				}
-			}
+				SDL_RenderPresent(sdlRenderer);
 
-			usleep(5000);
+				redraw = false;
+			}
 		}
 	}
 
@@ -190,5 +422,9 @@ int main(int argc, char* argv[]) {
 
 	SDL_Quit();
 
+	// the render thread has finished with the renderer's destruction
+	if(vm.count("trace"))
+		writeTrace(vm["trace"].as<std::string>());
+
 	return 0;
 }
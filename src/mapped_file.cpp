@@ -0,0 +1,60 @@
+#include "mapped_file.h"
+
+#include <stdexcept>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+MappedFile::MappedFile(const boost::filesystem::path& path) : m_data(nullptr), m_size(0) {
+	const int fd = open(path.string().c_str(), O_RDONLY);
+	if(fd < 0)
+		throw std::runtime_error("cannot open file - " + path.string());
+
+	struct stat st;
+	if(fstat(fd, &st) != 0) {
+		close(fd);
+		throw std::runtime_error("cannot read file size - " + path.string());
+	}
+
+	m_size = st.st_size;
+
+	// an empty file can't be mapped, but is a valid (empty) input
+	if(m_size > 0) {
+		m_data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if(m_data == MAP_FAILED) {
+			close(fd);
+			throw std::runtime_error("cannot map file - " + path.string());
+		}
+	}
+
+	// the mapping stays valid after the descriptor is closed
+	close(fd);
+}
+
+MappedFile::~MappedFile() {
+	if(m_data != nullptr)
+		munmap(m_data, m_size);
+}
+
+void MappedFile::adviseSequential() const {
+	if(m_data != nullptr)
+		madvise(m_data, m_size, MADV_SEQUENTIAL);
+}
+
+const char* MappedFile::data() const {
+	return (const char*)m_data;
+}
+
+std::size_t MappedFile::size() const {
+	return m_size;
+}
+
+const char* MappedFile::begin() const {
+	return data();
+}
+
+const char* MappedFile::end() const {
+	return data() + m_size;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstddef>
+
+#include <boost/noncopyable.hpp>
+#include <boost/filesystem/path.hpp>
+
+/// A read-only memory mapping of a whole file, released on destruction
+class MappedFile : public boost::noncopyable {
+	public:
+		MappedFile(const boost::filesystem::path& path);
+		~MappedFile();
+
+		/// hints the kernel that the file is going to be read once from start to end
+		void adviseSequential() const;
+
+		const char* data() const;
+		std::size_t size() const;
+
+		const char* begin() const;
+		const char* end() const;
+
+	private:
+		void* m_data;
+		std::size_t m_size;
+};
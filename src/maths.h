@@ -67,7 +67,7 @@ typedef Vec3 Vertex;
 
 struct Triangle {
 	unsigned v0, v1, v2;
-} __attribute__((aligned(32)));
+};
 
 struct Ray {
 	Vec3 origin;
@@ -108,18 +108,24 @@ struct Camera {
 	Vec3 target = Vec3(0, 0, 0);
 	Vec3 position = Vec3(0, 0, -500);
 
-	/// a silly version of "making rays" from screen coordinates (x and y are in -1..1)
-	Ray makeRay(float x, float y) const {
+	/// the orthonormal basis of the view
+	void basis(Vec3& fwd, Vec3& side, Vec3& up) const {
 		static const Vec3 s_up(0, 1, 0);
 
-		Vec3 fwd = target - position;
+		fwd = target - position;
 		fwd.normalize();
 
-		Vec3 side = s_up.cross(fwd);
+		side = s_up.cross(fwd);
 		side.normalize();
 
-		Vec3 up = fwd.cross(side);
+		up = fwd.cross(side);
 		up.normalize();
+	}
+
+	/// a silly version of "making rays" from screen coordinates (x and y are in -1..1)
+	Ray makeRay(float x, float y) const {
+		Vec3 fwd, side, up;
+		basis(fwd, side, up);
 
 		Vec3 dir = fwd + side * -x + up * y;
 		dir.normalize();
@@ -130,6 +136,15 @@ struct Camera {
 		};
 	}
 
+	/// the ray through a pixel of a w x h image
+	Ray pixelRay(int x, int y, int w, int h) const {
+		const float xf = ((float)x / (float)w - 0.5f) * 2.0f;
+		const float yf = ((float)y / (float)h - 0.5f) * 2.0f;
+		const float aspect = (float)w / (float)h;
+
+		return makeRay(xf, -yf / aspect);
+	}
+
 	void rotate(float xangle, float yangle) {
 		Vec3 dir = target - position;
 
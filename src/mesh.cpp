@@ -64,6 +64,10 @@ Mesh::Vertices::const_iterator Mesh::Vertices::end() const {
 	return m_vertices + m_size;
 }
 
+std::size_t Mesh::Vertices::size() const {
+	return m_size;
+}
+
 ///////////////////
 
 Mesh::GeometryHandle::GeometryHandle(const Device& device) : m_geometry(rtcNewGeometry(device, RTC_GEOMETRY_TYPE_TRIANGLE)) {
@@ -83,13 +87,47 @@ Mesh::GeometryHandle::operator const RTCGeometry& () const {
 
 ///////////////////
 
-Mesh::Mesh(std::size_t vertexCount, std::size_t triangleCount) : m_geom(new GeometryHandle(m_device)),
+Mesh::Mesh(std::size_t vertexCount, std::size_t triangleCount, bool normals) : m_geom(new GeometryHandle(m_device)),
 	m_vertices((Vertex *)rtcSetNewGeometryBuffer(*m_geom, RTC_BUFFER_TYPE_VERTEX, 0, RTC_FORMAT_FLOAT3, sizeof(Vertex),
 	           vertexCount), vertexCount),
+	m_normals(nullptr, 0),
 	m_triangles((Triangle *)rtcSetNewGeometryBuffer(*m_geom, RTC_BUFFER_TYPE_INDEX, 0, RTC_FORMAT_UINT3, sizeof(Triangle),
-	            triangleCount), triangleCount)
+	            triangleCount), triangleCount), m_triangleCount(triangleCount)
 {
+	if(normals) {
+		rtcSetGeometryVertexAttributeCount(*m_geom, 1);
+		m_normals = Vertices((Vertex *)rtcSetNewGeometryBuffer(*m_geom, RTC_BUFFER_TYPE_VERTEX_ATTRIBUTE, 0, RTC_FORMAT_FLOAT3,
+		                     sizeof(Vertex), vertexCount), vertexCount);
 
+		rtcSetGeometryUserData(*m_geom, m_normals.begin());
+	}
+}
+
+Mesh::Mesh(std::shared_ptr<const void> storage, const Vertex* vertices, std::size_t vertexCount,
+           const Triangle* triangles, std::size_t triangleCount, const Vec3* normals) :
+	Mesh(storage, &vertices->x, vertexCount, sizeof(Vertex), &triangles->v0, triangleCount, sizeof(Triangle),
+	     normals != nullptr ? &normals->x : nullptr, sizeof(Vec3))
+{
+}
+
+Mesh::Mesh(std::shared_ptr<const void> storage, const float* positions, std::size_t vertexCount, std::size_t vertexStride,
+           const unsigned* indices, std::size_t triangleCount, std::size_t triangleStride,
+           const float* normals, std::size_t normalStride) : m_geom(new GeometryHandle(m_device)), m_storage(storage),
+	m_vertices(vertexStride == sizeof(Vertex) ? (Vertex*)positions : nullptr, vertexStride == sizeof(Vertex) ? vertexCount : 0),
+	m_normals(normals != nullptr && normalStride == sizeof(Vertex) ? (Vertex*)normals : nullptr,
+	          normals != nullptr && normalStride == sizeof(Vertex) ? vertexCount : 0),
+	m_triangles(triangleStride == sizeof(Triangle) ? (Triangle*)indices : nullptr, triangleStride == sizeof(Triangle) ? triangleCount : 0),
+	m_triangleCount(triangleCount)
+{
+	rtcSetSharedGeometryBuffer(*m_geom, RTC_BUFFER_TYPE_VERTEX, 0, RTC_FORMAT_FLOAT3, positions, 0, vertexStride, vertexCount);
+	rtcSetSharedGeometryBuffer(*m_geom, RTC_BUFFER_TYPE_INDEX, 0, RTC_FORMAT_UINT3, indices, 0, triangleStride, triangleCount);
+
+	if(normals != nullptr) {
+		rtcSetGeometryVertexAttributeCount(*m_geom, 1);
+		rtcSetSharedGeometryBuffer(*m_geom, RTC_BUFFER_TYPE_VERTEX_ATTRIBUTE, 0, RTC_FORMAT_FLOAT3, normals, 0, normalStride, vertexCount);
+
+		rtcSetGeometryUserData(*m_geom, const_cast<float*>(normals));
+	}
 }
 
 Mesh::~Mesh() {
@@ -104,6 +142,14 @@ const Mesh::Vertices& Mesh::vertices() const {
 	return m_vertices;
 }
 
+Mesh::Vertices& Mesh::normals() {
+	return m_normals;
+}
+
+const Mesh::Vertices& Mesh::normals() const {
+	return m_normals;
+}
+
 Mesh::Triangles& Mesh::triangles() {
 	return m_triangles;
 }
@@ -112,24 +158,36 @@ const Mesh::Triangles& Mesh::triangles() const {
 	return m_triangles;
 }
 
-Mesh::Mesh(Mesh&& m) : m_device(m.m_device), m_geom(std::move(m.m_geom)), m_vertices(m.m_vertices), m_triangles(m.m_triangles) {
+Mesh::Mesh(Mesh&& m) : m_device(m.m_device), m_geom(std::move(m.m_geom)), m_storage(std::move(m.m_storage)), m_vertices(m.m_vertices), m_normals(m.m_normals), m_triangles(m.m_triangles),
+	m_triangleCount(m.m_triangleCount) {
 
 }
 
 Mesh& Mesh::operator=(Mesh&& m) {
 	m_device = m.m_device;
 	m_geom = std::move(m.m_geom);
+	m_storage = std::move(m.m_storage);
 	m_vertices = m.m_vertices;
+	m_normals = m.m_normals;
 	m_triangles = m.m_triangles;
+	m_triangleCount = m.m_triangleCount;
 
 	return *this;
 }
 
+std::size_t Mesh::triangleCount() const {
+	return m_triangleCount;
+}
+
 const RTCGeometry& Mesh::geom() const {
 	assert(m_geom != nullptr);
 	return *m_geom;
 }
 
+const std::shared_ptr<const void>& Mesh::storage() const {
+	return m_storage;
+}
+
 Mesh Mesh::makeSphere(const Vec3& p, float r, int numPhi, int numTheta) {
 	Mesh result(numTheta * (numPhi + 1), 2 * numTheta * (numPhi - 1));
 
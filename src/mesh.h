@@ -52,6 +52,8 @@ class Mesh {
 				const_iterator begin() const;
 				const_iterator end() const;
 
+				std::size_t size() const;
+
 			private:
 				Vertices(Vertex* ptr, std::size_t size);
 
@@ -64,7 +66,21 @@ class Mesh {
 				friend class Mesh;
 		};
 
-		Mesh(std::size_t vertexCount, std::size_t triangleCount);
+		/// Creates a mesh with uninitialised buffers. Optional per-vertex normals are stored as Embree's vertex attribute
+		/// (slot 0) for smooth shading, with the geometry's user data pointing to them.
+		Mesh(std::size_t vertexCount, std::size_t triangleCount, bool normals = false);
+
+		/// Creates a mesh using existing vertex and index data without copying them (e.g., a memory-mapped file).
+		/// The data have to stay unchanged; storage is kept alive for the lifetime of the mesh.
+		Mesh(std::shared_ptr<const void> storage, const Vertex* vertices, std::size_t vertexCount,
+		     const Triangle* triangles, std::size_t triangleCount, const Vec3* normals = nullptr);
+
+		/// Creates a mesh from existing positions and normals (3 floats) and indices (3 unsigned ints per triangle) with
+		/// arbitrary byte strides, without copying them. vertices(), normals() and triangles() are empty unless the strides
+		/// match Vertex and Triangle.
+		Mesh(std::shared_ptr<const void> storage, const float* positions, std::size_t vertexCount, std::size_t vertexStride,
+		     const unsigned* indices, std::size_t triangleCount, std::size_t triangleStride,
+		     const float* normals = nullptr, std::size_t normalStride = 0);
 		~Mesh();
 
 		Mesh(const Mesh& m) = delete;
@@ -76,11 +92,21 @@ class Mesh {
 		Vertices& vertices();
 		const Vertices& vertices() const;
 
+		/// per-vertex normals (empty if the mesh has none)
+		Vertices& normals();
+		const Vertices& normals() const;
+
 		Triangles& triangles();
 		const Triangles& triangles() const;
 
+		/// number of triangles, including meshes with strided indices (which have empty triangles())
+		std::size_t triangleCount() const;
+
 		const RTCGeometry& geom() const;
 
+		/// external storage of the buffers (null if the buffers are owned by Embree)
+		const std::shared_ptr<const void>& storage() const;
+
 		static Mesh makeSphere(const Vec3& p, float r, int numPhi = 5, int numTheta = 10);
 
 	private:
@@ -102,6 +128,9 @@ class Mesh {
 		Device m_device;
 		std::unique_ptr<GeometryHandle> m_geom;
 
-		Vertices m_vertices;
+		std::shared_ptr<const void> m_storage;
+
+		Vertices m_vertices, m_normals;
 		Triangles m_triangles;
+		std::size_t m_triangleCount;
 };
@@ -0,0 +1,486 @@
+#include "mesh_building.h"
+
+#include <functional>
+#include <atomic>
+#include <unordered_map>
+#include <array>
+#include <algorithm>
+
+#include <tbb/parallel_for.h>
+#include <tbb/parallel_reduce.h>
+#include <tbb/parallel_scan.h>
+#include <tbb/blocked_range.h>
+
+#include "profiling.h"
+
+namespace {
+
+/// Running totals of the prefix sum over the polygon face counts
+struct Offsets {
+	std::size_t triangles = 0;
+	std::size_t indices = 0;
+};
+
+/// tbb::parallel_scan body - the pre-scan pass only sums the counts, the final pass knows the output offsets of
+/// its range and writes the triangles directly
+class Triangulate {
+	public:
+		Triangulate(const std::int32_t* faceCounts, const std::int32_t* faceIndices, Triangle* triangles) :
+			m_faceCounts(faceCounts), m_faceIndices(faceIndices), m_triangles(triangles) {
+		}
+
+		Triangulate(Triangulate& t, tbb::split) : m_faceCounts(t.m_faceCounts), m_faceIndices(t.m_faceIndices),
+			m_triangles(t.m_triangles) {
+		}
+
+		void operator()(const tbb::blocked_range<std::size_t>& r, tbb::pre_scan_tag) {
+			for(std::size_t f = r.begin(); f != r.end(); ++f) {
+				m_sum.triangles += triangleCount(m_faceCounts[f]);
+				m_sum.indices += m_faceCounts[f];
+			}
+		}
+
+		void operator()(const tbb::blocked_range<std::size_t>& r, tbb::final_scan_tag) {
+			Triangle* tr = m_triangles + m_sum.triangles;
+			const std::int32_t* index = m_faceIndices + m_sum.indices;
+
+			for(std::size_t f = r.begin(); f != r.end(); ++f) {
+				const std::int32_t count = m_faceCounts[f];
+				assert(count >= 3);
+
+				for(std::int32_t i = 1; i < count - 1; ++i) {
+					tr->v0 = index[0];
+					tr->v1 = index[i];
+					tr->v2 = index[i + 1];
+					++tr;
+				}
+
+				m_sum.triangles += triangleCount(count);
+				m_sum.indices += count;
+				index += count;
+			}
+		}
+
+		void reverse_join(Triangulate& left) {
+			m_sum.triangles += left.m_sum.triangles;
+			m_sum.indices += left.m_sum.indices;
+		}
+
+		void assign(Triangulate& b) {
+			m_sum = b.m_sum;
+		}
+
+		const Offsets& sum() const {
+			return m_sum;
+		}
+
+	private:
+		static std::size_t triangleCount(std::int32_t faceCount) {
+			return faceCount > 2 ? faceCount - 2 : 0;
+		}
+
+		const std::int32_t* m_faceCounts;
+		const std::int32_t* m_faceIndices;
+		Triangle* m_triangles;
+
+		Offsets m_sum;
+};
+
+/// number of polygons / vertices processed by a single task
+const std::size_t s_grainSize = 16384;
+
+/// replaces the values by the sums of all preceding values, and returns the total
+std::int32_t exclusiveScan(std::vector<std::int32_t>& values) {
+	return tbb::parallel_scan(tbb::blocked_range<std::size_t>(0, values.size(), s_grainSize), 0,
+		[&values](const tbb::blocked_range<std::size_t>& r, std::int32_t sum, bool final) {
+			for(std::size_t i = r.begin(); i != r.end(); ++i) {
+				const std::int32_t value = values[i];
+				if(final)
+					values[i] = sum;
+				sum += value;
+			}
+			return sum;
+		},
+		[](std::int32_t a, std::int32_t b) {
+			return a + b;
+		}
+	);
+}
+
+/// the first of the corners of a position before c with the same normal as c (or c if there is none)
+const std::int32_t* sameNormal(const std::int32_t* begin, const std::int32_t* c, const std::int32_t* normalIndices) {
+	const std::int32_t* result = begin;
+	while(normalIndices[*result] != normalIndices[*c])
+		++result;
+
+	return result;
+}
+
+Mesh allocateMesh(std::size_t vertexCount, std::size_t triangleCount, bool normals) {
+	LoadPhaseScope phase(kBufferFill);
+	return Mesh(vertexCount, triangleCount, normals);
+}
+
+}
+
+Mesh makePolygonMesh(const float* positions, std::size_t positionCount, std::size_t stride,
+                     const std::int32_t* faceCounts, std::size_t faceCount, const std::int32_t* faceIndices) {
+	return makePolygonMesh(positions, positionCount, stride, faceCounts, faceCount, faceIndices, nullptr, 0);
+}
+
+Mesh makePolygonMesh(const float* positions, std::size_t positionCount, std::size_t stride,
+                     const std::int32_t* faceCounts, std::size_t faceCount, const std::int32_t* faceIndices,
+                     const float* normals, std::size_t normalStride, const std::int32_t* normalIndices) {
+	assert(stride >= 3);
+
+	Offsets total;
+	std::vector<std::int32_t> vertexPositions, vertexNormals, cornerIndices;
+	{
+		LoadPhaseScope phase(kTriangulation);
+
+		// the triangle count is needed upfront to allocate the index buffer
+		total = tbb::parallel_reduce(tbb::blocked_range<std::size_t>(0, faceCount, s_grainSize), Offsets(),
+			[faceCounts](const tbb::blocked_range<std::size_t>& r, Offsets sum) {
+				for(std::size_t f = r.begin(); f != r.end(); ++f) {
+					sum.triangles += faceCounts[f] > 2 ? faceCounts[f] - 2 : 0;
+					sum.indices += faceCounts[f];
+				}
+				return sum;
+			},
+			[](const Offsets& a, const Offsets& b) {
+				Offsets sum;
+				sum.triangles = a.triangles + b.triangles;
+				sum.indices = a.indices + b.indices;
+				return sum;
+			}
+		);
+
+		// per-corner normals - each unique (position, normal) pair becomes a vertex. The corners are grouped by position
+		// (usually only a few per position), so that the positions can be split independently.
+		if(normals != nullptr && normalIndices != nullptr) {
+			// the corners of each position, in offsets[p] .. offsets[p + 1] of corners
+			std::unique_ptr<std::atomic<std::int32_t>[]> cursors(new std::atomic<std::int32_t>[positionCount]);
+			tbb::parallel_for(tbb::blocked_range<std::size_t>(0, positionCount, s_grainSize), [&](const tbb::blocked_range<std::size_t>& r) {
+				for(std::size_t p = r.begin(); p != r.end(); ++p)
+					cursors[p].store(0, std::memory_order_relaxed);
+			});
+
+			tbb::parallel_for(tbb::blocked_range<std::size_t>(0, total.indices, s_grainSize), [&](const tbb::blocked_range<std::size_t>& r) {
+				for(std::size_t c = r.begin(); c != r.end(); ++c)
+					cursors[faceIndices[c]].fetch_add(1, std::memory_order_relaxed);
+			});
+
+			std::vector<std::int32_t> offsets(positionCount + 1, 0);
+			tbb::parallel_for(tbb::blocked_range<std::size_t>(0, positionCount, s_grainSize), [&](const tbb::blocked_range<std::size_t>& r) {
+				for(std::size_t p = r.begin(); p != r.end(); ++p) {
+					offsets[p] = cursors[p].load(std::memory_order_relaxed);
+					cursors[p].store(0, std::memory_order_relaxed);
+				}
+			});
+			exclusiveScan(offsets);
+
+			std::vector<std::int32_t> corners(total.indices);
+			tbb::parallel_for(tbb::blocked_range<std::size_t>(0, total.indices, s_grainSize), [&](const tbb::blocked_range<std::size_t>& r) {
+				for(std::size_t c = r.begin(); c != r.end(); ++c) {
+					const std::int32_t p = faceIndices[c];
+					corners[offsets[p] + cursors[p].fetch_add(1, std::memory_order_relaxed)] = c;
+				}
+			});
+
+			// the first corner with each normal of a position makes a vertex - counted first, to number the vertices
+			// of all positions with a prefix sum
+			std::vector<std::int32_t> vertexOffsets(positionCount + 1, 0);
+			tbb::parallel_for(tbb::blocked_range<std::size_t>(0, positionCount, s_grainSize), [&](const tbb::blocked_range<std::size_t>& r) {
+				for(std::size_t p = r.begin(); p != r.end(); ++p) {
+					// in the order of the corners, for the output not to depend on the scheduling
+					std::sort(corners.begin() + offsets[p], corners.begin() + offsets[p + 1]);
+
+					const std::int32_t* begin = corners.data() + offsets[p];
+					const std::int32_t* end = corners.data() + offsets[p + 1];
+					for(const std::int32_t* c = begin; c != end; ++c)
+						if(sameNormal(begin, c, normalIndices) == c)
+							++vertexOffsets[p];
+				}
+			});
+			const std::int32_t vertexCount = exclusiveScan(vertexOffsets);
+
+			vertexPositions.resize(vertexCount);
+			vertexNormals.resize(vertexCount);
+			cornerIndices.resize(total.indices);
+			tbb::parallel_for(tbb::blocked_range<std::size_t>(0, positionCount, s_grainSize), [&](const tbb::blocked_range<std::size_t>& r) {
+				for(std::size_t p = r.begin(); p != r.end(); ++p) {
+					const std::int32_t* begin = corners.data() + offsets[p];
+					const std::int32_t* end = corners.data() + offsets[p + 1];
+
+					std::int32_t v = vertexOffsets[p];
+					for(const std::int32_t* c = begin; c != end; ++c) {
+						const std::int32_t* d = sameNormal(begin, c, normalIndices);
+
+						if(d == c) {
+							vertexPositions[v] = p;
+							vertexNormals[v] = normalIndices[*c];
+							cornerIndices[*c] = v++;
+						}
+						else
+							cornerIndices[*c] = cornerIndices[*d];
+					}
+				}
+			});
+
+			faceIndices = cornerIndices.data();
+		}
+	}
+
+	const std::size_t vertexCount = cornerIndices.empty() ? positionCount : vertexPositions.size();
+
+	Mesh mesh = allocateMesh(vertexCount, total.triangles, normals != nullptr);
+
+	{
+		LoadPhaseScope phase(kBufferFill);
+
+		// transfer the vertices, in chunks simple enough for the compiler to vectorize
+		tbb::parallel_for(tbb::blocked_range<std::size_t>(0, vertexCount, s_grainSize), [&](const tbb::blocked_range<std::size_t>& r) {
+			Vertex* __restrict__ dest = mesh.vertices().begin();
+			const float* __restrict__ src = positions;
+
+			if(cornerIndices.empty())
+				for(std::size_t i = r.begin(); i != r.end(); ++i) {
+					dest[i].x = src[i * stride];
+					dest[i].y = src[i * stride + 1];
+					dest[i].z = src[i * stride + 2];
+				}
+
+			else
+				for(std::size_t i = r.begin(); i != r.end(); ++i) {
+					const std::size_t p = vertexPositions[i];
+					dest[i].x = src[p * stride];
+					dest[i].y = src[p * stride + 1];
+					dest[i].z = src[p * stride + 2];
+				}
+
+			if(normals != nullptr) {
+				Vertex* __restrict__ destNormals = mesh.normals().begin();
+
+				for(std::size_t i = r.begin(); i != r.end(); ++i) {
+					const std::size_t n = cornerIndices.empty() ? i : vertexNormals[i];
+					destNormals[i].x = normals[n * normalStride];
+					destNormals[i].y = normals[n * normalStride + 1];
+					destNormals[i].z = normals[n * normalStride + 2];
+				}
+			}
+		});
+	}
+
+	{
+		LoadPhaseScope phase(kTriangulation);
+
+		// triangulate, using a parallel prefix sum over the face counts to find each polygon's output offset
+		Triangulate body(faceCounts, faceIndices, mesh.triangles().begin());
+		tbb::parallel_scan(tbb::blocked_range<std::size_t>(0, faceCount, s_grainSize), body);
+		assert(body.sum().triangles == total.triangles);
+	}
+
+	return mesh;
+}
+
+namespace {
+
+/// A strip needs to be at least this many times longer than it is wide to be converted to a curve
+const float s_minStripAspect = 4.0f;
+
+std::uint64_t edgeKey(std::uint32_t a, std::uint32_t b) {
+	if(a > b)
+		std::swap(a, b);
+	return ((std::uint64_t)a << 32) | b;
+}
+
+/// Converts a polyline given by its points and radii to a linear or a Bezier curve.
+/// Bezier control points are placed using Catmull-Rom tangents, so the curve passes through all points.
+void appendCurve(Curves::Basis basis, const std::vector<CurveVertex>& points, std::vector<CurveVertex>& vertices, std::vector<unsigned>& segments) {
+	assert(points.size() >= 2);
+
+	if(basis == Curves::kLinear) {
+		for(std::size_t i = 0; i + 1 < points.size(); ++i)
+			segments.push_back(vertices.size() + i);
+		vertices.insert(vertices.end(), points.begin(), points.end());
+	}
+
+	else {
+		assert(basis == Curves::kBezier);
+
+		auto tangent = [&points](std::size_t i) {
+			const CurveVertex& prev = points[i > 0 ? i - 1 : 0];
+			const CurveVertex& next = points[std::min(i + 1, points.size() - 1)];
+			const float scale = (i > 0 && i + 1 < points.size()) ? 0.5f : 1.0f;
+
+			return CurveVertex{(next.x - prev.x) * scale, (next.y - prev.y) * scale, (next.z - prev.z) * scale, (next.r - prev.r) * scale};
+		};
+
+		for(std::size_t i = 0; i + 1 < points.size(); ++i) {
+			const CurveVertex& p0 = points[i];
+			const CurveVertex& p3 = points[i + 1];
+			const CurveVertex t0 = tangent(i);
+			const CurveVertex t3 = tangent(i + 1);
+
+			segments.push_back(vertices.size());
+
+			// the last vertex of a segment is shared with the first vertex of the next one
+			vertices.push_back(p0);
+			vertices.push_back(CurveVertex{p0.x + t0.x / 3.0f, p0.y + t0.y / 3.0f, p0.z + t0.z / 3.0f, p0.r + t0.r / 3.0f});
+			vertices.push_back(CurveVertex{p3.x - t3.x / 3.0f, p3.y - t3.y / 3.0f, p3.z - t3.z / 3.0f, p3.r - t3.r / 3.0f});
+		}
+		vertices.push_back(points.back());
+	}
+}
+
+}
+
+StripConversion convertStrips(Curves::Basis basis, const float* positions, std::size_t /*positionCount*/, std::size_t stride,
+                              const std::int32_t* faceCounts, std::size_t faceCount, const std::int32_t* faceIndices) {
+	// offsets of each face in the index array
+	std::vector<std::size_t> offsets(faceCount + 1, 0);
+	for(std::size_t f = 0; f < faceCount; ++f)
+		offsets[f + 1] = offsets[f] + faceCounts[f];
+
+	auto vertex = [&](std::size_t f, int corner) -> std::uint32_t {
+		return faceIndices[offsets[f] + (corner & 3)];
+	};
+
+	// edge adjacency of quads (-1 marks a non-manifold edge)
+	std::unordered_map<std::uint64_t, std::pair<std::int64_t, std::int64_t>> edges;
+	for(std::size_t f = 0; f < faceCount; ++f)
+		if(faceCounts[f] == 4)
+			for(int e = 0; e < 4; ++e) {
+				auto it = edges.insert(std::make_pair(edgeKey(vertex(f, e), vertex(f, e + 1)), std::make_pair((std::int64_t)f, (std::int64_t)-2)));
+				if(!it.second) {
+					if(it.first->second.second == -2)
+						it.first->second.second = f;
+					else
+						it.first->second = std::make_pair(-1, -1);
+				}
+			}
+
+	// neighbouring quad across each edge of each quad (or -1)
+	std::vector<std::array<std::int64_t, 4>> links(faceCount);
+	for(std::size_t f = 0; f < faceCount; ++f) {
+		links[f].fill(-1);
+		if(faceCounts[f] == 4)
+			for(int e = 0; e < 4; ++e) {
+				const auto& adj = edges[edgeKey(vertex(f, e), vertex(f, e + 1))];
+				if(adj.first >= 0 && adj.second >= 0)
+					links[f][e] = adj.first == (std::int64_t)f ? adj.second : adj.first;
+			}
+	}
+
+	// a quad can be part of a strip only if it links to at most 2 other quads, across opposite edges
+	std::vector<bool> inStrip(faceCount, false);
+	for(std::size_t f = 0; f < faceCount; ++f)
+		if(faceCounts[f] == 4) {
+			int count = 0;
+			for(int e = 0; e < 4; ++e)
+				count += links[f][e] >= 0;
+
+			inStrip[f] = count <= 1 || (count == 2 && ((links[f][0] >= 0 && links[f][2] >= 0) || (links[f][1] >= 0 && links[f][3] >= 0)));
+		}
+
+	for(std::size_t f = 0; f < faceCount; ++f)
+		for(int e = 0; e < 4; ++e)
+			if(links[f][e] >= 0 && !inStrip[links[f][e]])
+				links[f][e] = -1;
+
+	auto rungPoint = [&](std::size_t f, int e) {
+		const float* a = positions + vertex(f, e) * stride;
+		const float* b = positions + vertex(f, e + 1) * stride;
+
+		const Vec3 diff(a[0] - b[0], a[1] - b[1], a[2] - b[2]);
+		return CurveVertex{(a[0] + b[0]) * 0.5f, (a[1] + b[1]) * 0.5f, (a[2] + b[2]) * 0.5f, diff.length() * 0.5f};
+	};
+
+	// walk the strips, starting from their end quads
+	std::vector<CurveVertex> vertices;
+	std::vector<unsigned> segments;
+	std::vector<bool> converted(faceCount, false);
+	std::vector<std::size_t> strip;
+	std::vector<CurveVertex> points;
+
+	for(std::size_t start = 0; start < faceCount; ++start) {
+		if(!inStrip[start] || converted[start])
+			continue;
+
+		int linkCount = 0;
+		int entry = 0;
+		for(int e = 0; e < 4; ++e)
+			if(links[start][e] >= 0) {
+				++linkCount;
+				entry = (e + 2) & 3;
+			}
+
+		// closed loops of quads have no end, and are left as polygons
+		if(linkCount > 1)
+			continue;
+
+		// a single quad goes along its longer side
+		if(linkCount == 0) {
+			const CurveVertex r0 = rungPoint(start, 0);
+			const CurveVertex r1 = rungPoint(start, 1);
+			entry = r0.r < r1.r ? 0 : 1;
+		}
+
+		// collect the rungs - the entry edge of the first quad, and the opposite edge of each quad
+		strip.clear();
+		points.clear();
+
+		std::size_t f = start;
+		points.push_back(rungPoint(f, entry));
+		while(true) {
+			strip.push_back(f);
+
+			const int exit = (entry + 2) & 3;
+			points.push_back(rungPoint(f, exit));
+
+			const std::int64_t next = links[f][exit];
+			if(next < 0)
+				break;
+
+			// find the shared edge in the next quad
+			const std::uint64_t key = edgeKey(vertex(f, exit), vertex(f, exit + 1));
+			entry = 0;
+			while(edgeKey(vertex(next, entry), vertex(next, entry + 1)) != key)
+				++entry;
+
+			f = next;
+		}
+
+		// only elongated strips are converted
+		float length = 0.0f, width = 0.0f;
+		for(std::size_t i = 0; i < points.size(); ++i) {
+			width += points[i].r * 2.0f / (float)points.size();
+			if(i > 0)
+				length += Vec3(points[i].x - points[i-1].x, points[i].y - points[i-1].y, points[i].z - points[i-1].z).length();
+		}
+
+		if(length < width * s_minStripAspect)
+			continue;
+
+		for(auto& q : strip)
+			converted[q] = true;
+
+		appendCurve(basis, points, vertices, segments);
+	}
+
+	StripConversion result;
+
+	if(!segments.empty()) {
+		result.curves.reset(new Curves(basis, vertices.size(), segments.size()));
+		std::copy(vertices.begin(), vertices.end(), result.curves->vertices().begin());
+		std::copy(segments.begin(), segments.end(), result.curves->segments().begin());
+	}
+
+	for(std::size_t f = 0; f < faceCount; ++f)
+		if(!converted[f]) {
+			result.faceCounts.push_back(faceCounts[f]);
+			result.faceIndices.insert(result.faceIndices.end(), faceIndices + offsets[f], faceIndices + offsets[f + 1]);
+		}
+
+	return result;
+}
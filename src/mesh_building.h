@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <memory>
+
+#include "mesh.h"
+#include "curves.h"
+
+/// Makes a triangle mesh from a polygonal description - faceCounts contains the number of vertices of each
+/// polygon, with their vertex indices stored consecutively in faceIndices. Polygons are triangulated as fans.
+/// Positions are read as 3 floats per vertex, with stride floats between consecutive vertices.
+/// Both the vertex transfer and the triangulation run in parallel, writing directly to Embree's buffers.
+Mesh makePolygonMesh(const float* positions, std::size_t positionCount, std::size_t stride,
+                     const std::int32_t* faceCounts, std::size_t faceCount, const std::int32_t* faceIndices);
+
+/// A polygon mesh with normals (3 floats each, with normalStride floats between consecutive normals), stored as a vertex
+/// attribute. Without normalIndices, there is one normal per vertex. With normalIndices, normals are indexed per polygon
+/// corner (in the same order as faceIndices), and vertices with more than one normal are split (in parallel too).
+Mesh makePolygonMesh(const float* positions, std::size_t positionCount, std::size_t stride,
+                     const std::int32_t* faceCounts, std::size_t faceCount, const std::int32_t* faceIndices,
+                     const float* normals, std::size_t normalStride, const std::int32_t* normalIndices = nullptr);
+
+/// Result of a conversion of quad strips to ribbon curves
+struct StripConversion {
+	/// curves made from all strips found (null if there were none)
+	std::unique_ptr<Curves> curves;
+
+	/// the remaining polygons, which were not part of any strip
+	std::vector<std::int32_t> faceCounts, faceIndices;
+};
+
+/// Finds strip-like chains of quads (e.g., grass blades) in a polygonal mesh, and converts each of them
+/// into a single ribbon curve following the centers of its "rungs" (the edges shared by consecutive
+/// quads), with the width given by the rung length. Only linear and Bezier bases are supported.
+/// Other arguments follow makePolygonMesh().
+StripConversion convertStrips(Curves::Basis basis, const float* positions, std::size_t positionCount, std::size_t stride,
+                              const std::int32_t* faceCounts, std::size_t faceCount, const std::int32_t* faceIndices);
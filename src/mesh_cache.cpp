@@ -0,0 +1,223 @@
+#include "mesh_cache.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <functional>
+#include <stdexcept>
+
+#include <boost/filesystem.hpp>
+
+#include "mapped_file.h"
+#include "profiling.h"
+
+namespace {
+
+MeshCacheOptions s_options;
+
+/// Layout of a cache file: a header, followed by a table of objects, followed by their vertex, normal and index blobs
+/// (each aligned to s_alignment bytes, in the in-memory layout of Vertex and Triangle).
+struct Header {
+	char magic[8];
+	std::uint32_t version;
+	std::uint32_t objectCount;
+
+	/// size and modification time of the source file the cache was generated from
+	std::uint64_t sourceSize;
+	std::int64_t sourceTime;
+};
+
+struct Object {
+	std::uint64_t vertexOffset, vertexCount;
+	std::uint64_t triangleOffset, triangleCount;
+
+	/// one normal per vertex; 0 for objects without normals
+	std::uint64_t normalOffset;
+};
+
+const char s_magic[8] = {'E', 'V', 'M', 'E', 'S', 'H', '\0', '\0'};
+const std::uint32_t s_version = 2;
+const std::size_t s_alignment = 16;
+
+static_assert(sizeof(Vertex) == 16, "unexpected Vertex layout");
+static_assert(sizeof(Triangle) == 12, "unexpected Triangle layout");
+
+std::uint64_t align(std::uint64_t offset) {
+	return (offset + s_alignment - 1) / s_alignment * s_alignment;
+}
+
+/// true if count elements at offset (aligned) are within a file, without overflowing
+bool inFile(std::uint64_t offset, std::uint64_t count, std::size_t elementSize, std::size_t fileSize) {
+	return offset % s_alignment == 0 && offset <= fileSize && count <= (fileSize - offset) / elementSize;
+}
+
+boost::filesystem::path cachePath(const boost::filesystem::path& source) {
+	const std::string filename = source.filename().string();
+
+	if(s_options.directory.empty())
+		return source.parent_path() / (filename + ".meshcache");
+
+	// files of the same name from different directories share the cache directory
+	const std::size_t hash = std::hash<std::string>()(boost::filesystem::absolute(source).string());
+	char suffix[32];
+	snprintf(suffix, sizeof(suffix), "-%016zx.meshcache", hash);
+
+	return s_options.directory / (filename + suffix);
+}
+
+}
+
+void setMeshCacheOptions(const MeshCacheOptions& options) {
+	s_options = options;
+}
+
+const MeshCacheOptions& meshCacheOptions() {
+	return s_options;
+}
+
+bool readMeshCache(const boost::filesystem::path& source, std::vector<Mesh>& meshes) {
+	if(!s_options.enabled)
+		return false;
+
+	LoadPhaseScope phase(kFileIO);
+
+	const boost::filesystem::path path = cachePath(source);
+	if(!boost::filesystem::exists(path))
+		return false;
+
+	// an unreadable cache is ignored like a missing one, and the source is parsed instead
+	std::shared_ptr<MappedFile> file;
+	try {
+		file = std::make_shared<MappedFile>(path);
+	}
+	catch(const std::runtime_error& e) {
+		std::cerr << "Warning: cannot read mesh cache " << path << " - " << e.what() << std::endl;
+		return false;
+	}
+
+	if(file->size() < sizeof(Header))
+		return false;
+
+	const Header& header = *(const Header*)file->data();
+	if(memcmp(header.magic, s_magic, sizeof(s_magic)) != 0 || header.version != s_version)
+		return false;
+
+	// stale cache - the source has changed since it was written
+	if(header.sourceSize != boost::filesystem::file_size(source) || header.sourceTime != boost::filesystem::last_write_time(source))
+		return false;
+
+	if(header.objectCount > (file->size() - sizeof(Header)) / sizeof(Object))
+		return false;
+
+	const Object* objects = (const Object*)(file->data() + sizeof(Header));
+	for(std::size_t o = 0; o < header.objectCount; ++o) {
+		const Object& obj = objects[o];
+
+		if(!inFile(obj.vertexOffset, obj.vertexCount, sizeof(Vertex), file->size()) ||
+		   !inFile(obj.triangleOffset, obj.triangleCount, sizeof(Triangle), file->size()) ||
+		   !inFile(obj.normalOffset, obj.normalOffset != 0 ? obj.vertexCount : 0, sizeof(Vertex), file->size()))
+			return false;
+
+		// Embree doesn't check the indices, and a corrupt (or copied) cache can still match the source's size and time
+		const unsigned* indices = (const unsigned*)(file->data() + obj.triangleOffset);
+		for(std::uint64_t i = 0; i < obj.triangleCount * 3; ++i)
+			if(indices[i] >= obj.vertexCount)
+				return false;
+	}
+
+	meshes.reserve(meshes.size() + header.objectCount);
+	for(std::size_t o = 0; o < header.objectCount; ++o) {
+		const Object& obj = objects[o];
+
+		meshes.push_back(Mesh(file, (const Vertex*)(file->data() + obj.vertexOffset), obj.vertexCount,
+		                      (const Triangle*)(file->data() + obj.triangleOffset), obj.triangleCount,
+		                      obj.normalOffset != 0 ? (const Vec3*)(file->data() + obj.normalOffset) : nullptr));
+	}
+
+	return true;
+}
+
+void writeMeshCache(const boost::filesystem::path& source, const std::vector<Mesh>& meshes) {
+	if(!s_options.enabled)
+		return;
+
+	LoadPhaseScope phase(kFileIO);
+
+	const boost::filesystem::path path = cachePath(source);
+
+	Header header;
+	memcpy(header.magic, s_magic, sizeof(s_magic));
+	header.version = s_version;
+	header.objectCount = meshes.size();
+	header.sourceSize = boost::filesystem::file_size(source);
+	header.sourceTime = boost::filesystem::last_write_time(source);
+
+	std::vector<Object> objects(meshes.size());
+	std::uint64_t offset = align(sizeof(Header) + objects.size() * sizeof(Object));
+	for(std::size_t o = 0; o < meshes.size(); ++o) {
+		objects[o].vertexOffset = offset;
+		objects[o].vertexCount = meshes[o].vertices().size();
+		offset = align(offset + objects[o].vertexCount * sizeof(Vertex));
+
+		objects[o].normalOffset = 0;
+		if(meshes[o].normals().size() > 0) {
+			objects[o].normalOffset = offset;
+			offset = align(offset + objects[o].vertexCount * sizeof(Vertex));
+		}
+
+		objects[o].triangleOffset = offset;
+		objects[o].triangleCount = meshes[o].triangles().size();
+		offset = align(offset + objects[o].triangleCount * sizeof(Triangle));
+	}
+
+	// written under a temporary name first, so a concurrent or interrupted write never leaves a partial cache file behind
+	boost::system::error_code err;
+	if(!path.parent_path().empty())
+		boost::filesystem::create_directories(path.parent_path(), err);
+
+	const boost::filesystem::path tmp = path.parent_path() / boost::filesystem::unique_path(path.filename().string() + "-%%%%%%");
+	{
+		std::ofstream file(tmp.string(), std::ios::binary);
+		if(!file.good()) {
+			std::cerr << "Warning: cannot write mesh cache " << path << std::endl;
+			return;
+		}
+
+		auto pad = [&file](std::uint64_t target) {
+			static const char zeros[s_alignment] = {0};
+			file.write(zeros, target - file.tellp());
+		};
+
+		file.write((const char*)&header, sizeof(header));
+		file.write((const char*)objects.data(), objects.size() * sizeof(Object));
+
+		for(std::size_t o = 0; o < meshes.size(); ++o) {
+			pad(objects[o].vertexOffset);
+			file.write((const char*)meshes[o].vertices().begin(), objects[o].vertexCount * sizeof(Vertex));
+
+			if(objects[o].normalOffset != 0) {
+				pad(objects[o].normalOffset);
+				file.write((const char*)meshes[o].normals().begin(), objects[o].vertexCount * sizeof(Vertex));
+			}
+
+			pad(objects[o].triangleOffset);
+			file.write((const char*)meshes[o].triangles().begin(), objects[o].triangleCount * sizeof(Triangle));
+		}
+		pad(offset);
+
+		if(!file.good()) {
+			std::cerr << "Warning: cannot write mesh cache " << path << std::endl;
+			file.close();
+			boost::filesystem::remove(tmp, err);
+			return;
+		}
+	}
+
+	boost::filesystem::rename(tmp, path, err);
+	if(err) {
+		std::cerr << "Warning: cannot write mesh cache " << path << " - " << err.message() << std::endl;
+		boost::filesystem::remove(tmp, err);
+	}
+}
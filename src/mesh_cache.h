@@ -0,0 +1,27 @@
+#pragma once
+
+#include <vector>
+
+#include <boost/filesystem/path.hpp>
+
+#include "mesh.h"
+
+/// Settings of the binary mesh cache, used to avoid parsing text mesh formats repeatedly
+struct MeshCacheOptions {
+	bool enabled = true;
+
+	/// directory for the cache files; an empty path places each cache file next to its source file
+	boost::filesystem::path directory;
+};
+
+/// Changes the settings used by all subsequent mesh cache operations
+void setMeshCacheOptions(const MeshCacheOptions& options);
+const MeshCacheOptions& meshCacheOptions();
+
+/// Reads the cached meshes of a source file, mapping the cache file directly into the mesh buffers.
+/// Returns false if the cache is disabled, missing, unreadable, invalid (e.g., with out-of-range indices), or doesn't
+/// match the size and modification time of the source.
+bool readMeshCache(const boost::filesystem::path& source, std::vector<Mesh>& meshes);
+
+/// Writes the meshes of a source file to its cache file. Failures are reported, but not fatal.
+void writeMeshCache(const boost::filesystem::path& source, const std::vector<Mesh>& meshes);
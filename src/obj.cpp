@@ -1,133 +1,454 @@
 #include "obj.h"
 
-#include <fstream>
-#include <sstream>
 #include <string>
 #include <cassert>
+#include <cstring>
+#include <cmath>
+#include <stdexcept>
+#include <algorithm>
+#include <limits>
+#include <memory>
 
 #include <boost/filesystem.hpp>
 
+#include <tbb/parallel_for.h>
+
 #include "maths.h"
 #include "mesh.h"
+#include "mesh_building.h"
+#include "mapped_file.h"
+#include "mesh_cache.h"
+#include "profiling.h"
 
 namespace {
-	struct Face {
-		int v = -1;
-		int vn = -1;
-		int vt = -1;
+	/// Parsed contents of an OBJ file
+	struct ObjData {
+		std::vector<Vec3> vertices, normals;
+
+		/// polygons, stored as vertex counts and consecutive (0-based) vertex indices
+		std::vector<std::int32_t> faceCounts, faceIndices;
+
+		/// normal index of each polygon corner (parallel to faceIndices), or -1 for corners without a normal
+		std::vector<std::int32_t> faceNormals;
+
+		/// index of the first face of each object (started by an "o" line)
+		std::vector<std::size_t> objects;
+
+		/// positions in faceIndices of indices given relative to the end of the vertex list,
+		/// which need to be offset by the number of vertices preceding this chunk of the file
+		std::vector<std::size_t> relativeIndices;
+
+		/// positions in faceNormals of relative normal indices
+		std::vector<std::size_t> relativeNormals;
 	};
 
-	std::istream& operator >> (std::istream& in, Face& f) {
-		f.v = -1;
-		f.vn = -1;
-		f.vt = -1;
+	/// target size of a chunk of the file parsed by a single task
+	static const std::size_t s_chunkSize = 4 * 1024 * 1024;
 
-		in >> f.v;
-		if(in.peek() == '/') {
-			in.get();
+	inline bool isDigit(char c) {
+		return c >= '0' && c <= '9';
+	}
 
-			if(in.peek() != '/')
-				in >> f.vt;
+	inline bool isBlank(char c) {
+		return c == ' ' || c == '\t' || c == '\r';
+	}
 
-			assert(in.peek() == '/');
-			in.get();
+	inline const char* skipBlanks(const char* p, const char* end) {
+		while(p < end && isBlank(*p))
+			++p;
+		return p;
+	}
 
-			if(in.peek() >= '0' && in.peek() <= '9')
-				in >> f.vn;
+	inline const char* skipToken(const char* p, const char* end) {
+		while(p < end && !isBlank(*p) && *p != '\n')
+			++p;
+		return p;
+	}
 
-			assert(in.peek() != '/');
+	/// returns the start of the next line
+	inline const char* skipLine(const char* p, const char* end) {
+		const char* eol = (const char*)memchr(p, '\n', end - p);
+		return eol != nullptr ? eol + 1 : end;
+	}
+
+	inline std::int64_t parseInt(const char*& p, const char* end) {
+		bool negative = false;
+		if(p < end && (*p == '-' || *p == '+')) {
+			negative = *p == '-';
+			++p;
 		}
 
-		return in;
-	}
+		std::int64_t result = 0;
+		while(p < end && isDigit(*p)) {
+			result = result * 10 + (*p - '0');
+			++p;
+		}
 
-	Mesh makeMesh(const std::vector<Vec3>& v, const std::vector<std::vector<Face>>& f) {
-		std::size_t triangleCount = 0;
-		for(auto& t : f)
-			triangleCount += t.size()-2;
+		return negative ? -result : result;
+	}
 
-		Mesh result(v.size(), triangleCount);
+	/// Decimal floating point parsing, without the locale handling and error reporting of iostreams.
+	/// Up to 18 significant digits are accumulated in an integer, which is then scaled by a power of 10.
+	inline float parseFloat(const char*& p, const char* end) {
+		static const double s_powers[] = {
+			1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+			1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+		};
+
+		bool negative = false;
+		if(p < end && (*p == '-' || *p == '+')) {
+			negative = *p == '-';
+			++p;
+		}
 
-		std::copy(v.begin(), v.end(), result.vertices().begin());
+		std::uint64_t mantissa = 0;
+		int exponent = 0;
 
-		std::size_t triangleIndex = 0;
-		for(auto& t : f) {
-			for(std::size_t ti=1;ti < t.size()-1; ++ti) {
-				Triangle tr;
-				tr.v0 = t[0].v-1;
-				tr.v1 = t[ti].v-1;
-				tr.v2 = t[ti+1].v-1;
+		// integer part - digits beyond the mantissa's precision only increase the exponent
+		while(p < end && isDigit(*p)) {
+			if(mantissa < 100000000000000000ull)
+				mantissa = mantissa * 10 + (*p - '0');
+			else
+				++exponent;
+			++p;
+		}
 
-				result.triangles()[triangleIndex] = tr;
-				++triangleIndex;
+		// fractional part
+		if(p < end && *p == '.') {
+			++p;
+			while(p < end && isDigit(*p)) {
+				if(mantissa < 100000000000000000ull) {
+					mantissa = mantissa * 10 + (*p - '0');
+					--exponent;
+				}
+				++p;
 			}
 		}
-		assert(triangleIndex == triangleCount);
 
-		return result;
+		if(p < end && (*p == 'e' || *p == 'E')) {
+			++p;
+			exponent += parseInt(p, end);
+		}
+
+		double result = (double)mantissa;
+		if(exponent > 0)
+			result *= exponent <= 22 ? s_powers[exponent] : std::pow(10.0, exponent);
+		else if(exponent < 0)
+			result /= -exponent <= 22 ? s_powers[-exponent] : std::pow(10.0, -exponent);
+
+		return negative ? -result : result;
 	}
-}
 
-Scene loadObj(boost::filesystem::path path) {
-	assert(boost::filesystem::exists(path));
+	inline Vec3 parseVec3(const char*& p, const char* end) {
+		Vec3 v;
+		p = skipBlanks(p, end);
+		v.x = parseFloat(p, end);
+		p = skipBlanks(p, end);
+		v.y = parseFloat(p, end);
+		p = skipBlanks(p, end);
+		v.z = parseFloat(p, end);
+		return v;
+	}
 
-	Scene scene;
+	void parse(const char* p, const char* end, ObjData& data) {
+		while(p < end) {
+			p = skipBlanks(p, end);
+			if(p == end)
+				break;
+
+			// vertex
+			if(p + 1 < end && p[0] == 'v' && isBlank(p[1])) {
+				p += 2;
+				data.vertices.push_back(parseVec3(p, end));
+			}
+
+			// normal
+			else if(p + 2 < end && p[0] == 'v' && p[1] == 'n' && isBlank(p[2])) {
+				p += 3;
+				data.normals.push_back(parseVec3(p, end));
+			}
+
+			// face - a list of v[/vt][/vn] index triplets
+			else if(p + 1 < end && p[0] == 'f' && isBlank(p[1])) {
+				p += 2;
+
+				std::int32_t count = 0;
+				while(true) {
+					p = skipBlanks(p, end);
+					if(p == end || !(isDigit(*p) || *p == '-'))
+						break;
+
+					const std::int64_t index = parseInt(p, end);
+
+					// texture coordinate indices are ignored
+					std::int64_t normal = 0;
+					if(p < end && *p == '/') {
+						++p;
+						parseInt(p, end);
+
+						if(p < end && *p == '/') {
+							++p;
+							normal = parseInt(p, end);
+						}
+					}
+
+					if(index != 0) {
+						// negative indices are relative to the current end of the vertex (or normal) list
+						if(index > 0)
+							data.faceIndices.push_back(index - 1);
+						else {
+							data.relativeIndices.push_back(data.faceIndices.size());
+							data.faceIndices.push_back((std::int64_t)data.vertices.size() + index);
+						}
+
+						if(normal > 0)
+							data.faceNormals.push_back(normal - 1);
+						else if(normal < 0) {
+							data.relativeNormals.push_back(data.faceNormals.size());
+							data.faceNormals.push_back((std::int64_t)data.normals.size() + normal);
+						}
+						else
+							data.faceNormals.push_back(-1);
+
+						++count;
+					}
+
+					p = skipToken(p, end);
+				}
+
+				assert(count >= 3);
+				data.faceCounts.push_back(count);
+			}
+
+			// object
+			else if(p + 1 < end && p[0] == 'o' && isBlank(p[1]))
+				data.objects.push_back(data.faceCounts.size());
+
+			// everything else (comments, texture coordinates, materials, groups) is skipped
+			p = skipLine(p, end);
+		}
+	}
+
+	/// Parses the file in newline-aligned chunks in parallel, and concatenates the results
+	void parseParallel(const char* begin, const char* end, ObjData& data) {
+		const std::size_t chunkCount = std::max((std::size_t)(end - begin) / s_chunkSize, (std::size_t)1);
+
+		std::vector<const char*> bounds(chunkCount + 1);
+		bounds[0] = begin;
+		for(std::size_t c = 1; c < chunkCount; ++c)
+			bounds[c] = std::max(skipLine(begin + (end - begin) * c / chunkCount, end), bounds[c - 1]);
+		bounds[chunkCount] = end;
+
+		std::vector<ObjData> chunks(chunkCount);
+		tbb::parallel_for(std::size_t(0), chunkCount, [&](std::size_t c) {
+			parse(bounds[c], bounds[c + 1], chunks[c]);
+		});
+
+		// exclusive prefix sums of the per-chunk counts
+		std::vector<std::size_t> vertexOffsets(chunkCount + 1, 0), normalOffsets(chunkCount + 1, 0), faceOffsets(chunkCount + 1, 0),
+		                         indexOffsets(chunkCount + 1, 0);
+		for(std::size_t c = 0; c < chunkCount; ++c) {
+			vertexOffsets[c + 1] = vertexOffsets[c] + chunks[c].vertices.size();
+			normalOffsets[c + 1] = normalOffsets[c] + chunks[c].normals.size();
+			faceOffsets[c + 1] = faceOffsets[c] + chunks[c].faceCounts.size();
+			indexOffsets[c + 1] = indexOffsets[c] + chunks[c].faceIndices.size();
+		}
 
-	std::vector<Vec3> vertices, normals;
-	std::vector<std::vector<Face>> faces;
+		if(vertexOffsets[chunkCount] > (std::size_t)std::numeric_limits<std::int32_t>::max() ||
+		   normalOffsets[chunkCount] > (std::size_t)std::numeric_limits<std::int32_t>::max())
+			throw std::runtime_error("too many vertices in an OBJ file");
+
+		data.vertices.resize(vertexOffsets[chunkCount]);
+		data.normals.resize(normalOffsets[chunkCount]);
+		data.faceCounts.resize(faceOffsets[chunkCount]);
+		data.faceIndices.resize(indexOffsets[chunkCount]);
+		data.faceNormals.resize(indexOffsets[chunkCount]);
+
+		// objects are delimited by face indices, so an object started in one chunk simply continues through the following ones
+		for(std::size_t c = 0; c < chunkCount; ++c)
+			for(auto& o : chunks[c].objects)
+				data.objects.push_back(o + faceOffsets[c]);
+
+		tbb::parallel_for(std::size_t(0), chunkCount, [&](std::size_t c) {
+			ObjData& chunk = chunks[c];
+
+			for(auto& i : chunk.relativeIndices)
+				chunk.faceIndices[i] += vertexOffsets[c];
+			for(auto& i : chunk.relativeNormals)
+				chunk.faceNormals[i] += normalOffsets[c];
+
+			std::copy(chunk.vertices.begin(), chunk.vertices.end(), data.vertices.begin() + vertexOffsets[c]);
+			std::copy(chunk.normals.begin(), chunk.normals.end(), data.normals.begin() + normalOffsets[c]);
+			std::copy(chunk.faceCounts.begin(), chunk.faceCounts.end(), data.faceCounts.begin() + faceOffsets[c]);
+			std::copy(chunk.faceIndices.begin(), chunk.faceIndices.end(), data.faceIndices.begin() + indexOffsets[c]);
+			std::copy(chunk.faceNormals.begin(), chunk.faceNormals.end(), data.faceNormals.begin() + indexOffsets[c]);
+
+			// release the chunk's memory early
+			chunk = ObjData();
+		});
+	}
 
-	std::ifstream file(path.string());
+	/// Triangle meshes are collected in meshes (to allow caching them), curves are added to the scene directly.
+	/// Normals (indexed per polygon corner by normalIndices) are optional, and only used without strip conversion.
+	void addGeometry(Scene& scene, std::vector<Mesh>& meshes, const Vec3* v, std::size_t vertexCount, const std::int32_t* faceCounts, std::size_t faceCount, const std::int32_t* faceIndices,
+	                 const Vec3* normals, const std::int32_t* normalIndices, StripCurves strips) {
+		// Vec3 is padded to 16 bytes
+		static_assert(sizeof(Vec3) == 4 * sizeof(float), "unexpected Vec3 layout");
+
+		if(strips == kNoStripCurves) {
+			if(normals != nullptr)
+				meshes.push_back(makePolygonMesh(&v[0].x, vertexCount, 4, faceCounts, faceCount, faceIndices, &normals[0].x, 4, normalIndices));
+			else
+				meshes.push_back(makePolygonMesh(&v[0].x, vertexCount, 4, faceCounts, faceCount, faceIndices));
+		}
 
-	while(!file.eof()) {
-		std::string line;
-		std::getline(file, line);
+		else {
+			StripConversion conv = convertStrips(strips == kLinearStripCurves ? Curves::kLinear : Curves::kBezier,
+			                                     &v[0].x, vertexCount, 4, faceCounts, faceCount, faceIndices);
 
-		if(!line.empty() && line[0] != '#') {
-			std::stringstream linestr(line);
+			if(conv.curves)
+				scene.addMesh(std::move(*conv.curves));
 
-			std::string id;
-			linestr >> id;
+			if(!conv.faceCounts.empty())
+				meshes.push_back(makePolygonMesh(&v[0].x, vertexCount, 4, conv.faceCounts.data(), conv.faceCounts.size(), conv.faceIndices.data()));
+		}
+	}
 
-			if(id == "mtllib")
-				;
-			else if(id == "o") {
-				if(!vertices.empty()) {
-					scene.addMesh(makeMesh(vertices, faces));
+	/// Maps the global vertex indices of an OBJ file to compact per-object indices.
+	/// The table is shared between all objects and only the entries used by an object are reset afterwards,
+	/// keeping the compaction linear in the size of each object.
+	class VertexRemap {
+		public:
+			VertexRemap(std::size_t vertexCount) : m_table(vertexCount, -1) {
+			}
 
-					vertices.clear();
-					normals.clear();
-					faces.clear();
+			/// returns the compact index of a global vertex index, assigning a new one on first use
+			std::int32_t operator()(std::int32_t index) {
+				std::int32_t& result = m_table[index];
+				if(result < 0) {
+					result = m_used.size();
+					m_used.push_back(index);
 				}
+				return result;
 			}
-			else if(id == "v") {
-				Vec3 v;
-				linestr >> v.x >> v.y >> v.z;
 
-				vertices.push_back(v);
+			/// global indices of the referenced vertices, in the order of their compact indices
+			const std::vector<std::int32_t>& used() const {
+				return m_used;
 			}
-			else if(id == "vn") {
-				Vec3 n;
-				linestr >> n.x >> n.y >> n.z;
 
-				normals.push_back(n);
+			void clear() {
+				for(auto& i : m_used)
+					m_table[i] = -1;
+				m_used.clear();
 			}
-			else if(id == "f") {
-				faces.push_back(std::vector<Face>());
-				while(!linestr.eof()) {
-					Face f;
-					linestr >> f;
-
-					if(f.v > 0)
-						faces.back().push_back(f);
-				}
 
-				assert(faces.back().size() >= 3);
+		private:
+			std::vector<std::int32_t> m_table, m_used;
+	};
+
+	/// Adds the faces [faceBegin, faceEnd) as a single mesh, containing only the vertices they reference
+	void addObject(Scene& scene, std::vector<Mesh>& meshes, const ObjData& data, std::size_t faceBegin, std::size_t faceEnd, std::size_t indexBegin, VertexRemap& remap, StripCurves strips) {
+		std::size_t indexEnd = indexBegin;
+		for(std::size_t f = faceBegin; f < faceEnd; ++f)
+			indexEnd += data.faceCounts[f];
+
+		std::vector<std::int32_t> indices(indexEnd - indexBegin);
+		for(std::size_t i = indexBegin; i < indexEnd; ++i) {
+			const std::int32_t index = data.faceIndices[i];
+			if(index < 0 || index >= (std::int64_t)data.vertices.size())
+				throw std::runtime_error("vertex index out of range in an OBJ file");
+
+			indices[i - indexBegin] = remap(index);
+		}
+
+		// normals are only used if every corner of the object has one - they are referenced directly by their global index
+		bool hasNormals = indexEnd > indexBegin;
+		for(std::size_t i = indexBegin; i < indexEnd && hasNormals; ++i) {
+			hasNormals = data.faceNormals[i] >= 0;
+			if(data.faceNormals[i] >= (std::int64_t)data.normals.size())
+				throw std::runtime_error("normal index out of range in an OBJ file");
+		}
+
+		const Vec3* normals = hasNormals ? data.normals.data() : nullptr;
+		const std::int32_t* normalIndices = hasNormals ? &data.faceNormals[indexBegin] : nullptr;
+
+		const std::vector<std::int32_t>& used = remap.used();
+
+		// an object referencing a prefix of the vertex list in order (i.e., a single-object file) can use it directly
+		bool identity = true;
+		for(std::size_t i = 0; i < used.size() && identity; ++i)
+			identity = used[i] == (std::int32_t)i;
+
+		if(identity)
+			addGeometry(scene, meshes, data.vertices.data(), used.size(), &data.faceCounts[faceBegin], faceEnd - faceBegin,
+			            indices.data(), normals, normalIndices, strips);
+
+		else {
+			std::vector<Vec3> vertices(used.size());
+			for(std::size_t i = 0; i < used.size(); ++i)
+				vertices[i] = data.vertices[used[i]];
+
+			addGeometry(scene, meshes, vertices.data(), vertices.size(), &data.faceCounts[faceBegin], faceEnd - faceBegin,
+			            indices.data(), normals, normalIndices, strips);
+		}
+
+		remap.clear();
+	}
+}
+
+Scene loadObj(boost::filesystem::path path, StripCurves strips) {
+	TraceScope scope("loadObj");
+
+	assert(boost::filesystem::exists(path));
+
+	Scene scene;
+	std::vector<Mesh> meshes;
+
+	// the cache only stores triangle meshes, so it can't represent the result of strip conversion
+	const bool cached = strips == kNoStripCurves;
+
+	if(!cached || !readMeshCache(path, meshes)) {
+		ObjData data;
+		{
+			std::unique_ptr<MappedFile> file;
+			{
+				LoadPhaseScope phase(kFileIO);
+				file = std::unique_ptr<MappedFile>(new MappedFile(path));
+				file->adviseSequential();
 			}
+
+			// includes the page faults of reading the mapped file
+			LoadPhaseScope phase(kParsing);
+			parseParallel(file->begin(), file->end(), data);
 		}
+
+		// each object becomes a separate mesh
+		std::vector<std::size_t> boundaries = data.objects;
+		boundaries.insert(boundaries.begin(), 0);
+		boundaries.push_back(data.faceCounts.size());
+
+		VertexRemap remap(data.vertices.size());
+
+		std::size_t indexBegin = 0;
+		for(std::size_t o = 0; o + 1 < boundaries.size(); ++o) {
+			const std::size_t faceBegin = boundaries[o];
+			const std::size_t faceEnd = boundaries[o + 1];
+
+			if(faceEnd > faceBegin) {
+				addObject(scene, meshes, data, faceBegin, faceEnd, indexBegin, remap, strips);
+
+				for(std::size_t f = faceBegin; f < faceEnd; ++f)
+					indexBegin += data.faceCounts[f];
+			}
+		}
+
+		if(cached)
+			writeMeshCache(path, meshes);
 	}
 
-	if(!vertices.empty())
-		scene.addMesh(makeMesh(vertices, faces));
+	for(auto& m : meshes)
+		scene.addMesh(std::move(m));
 
 	return scene;
 }
@@ -4,4 +4,11 @@
 
 #include "scene.h"
 
-Scene loadObj(boost::filesystem::path path);
+/// Optional conversion of strip-like chains of quads (e.g., grass blades) to flat ribbon curves
+enum StripCurves {
+	kNoStripCurves,
+	kLinearStripCurves,
+	kBezierStripCurves
+};
+
+Scene loadObj(boost::filesystem::path path, StripCurves strips = kNoStripCurves);
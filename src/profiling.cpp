@@ -0,0 +1,174 @@
+#include "profiling.h"
+
+#include <atomic>
+#include <cassert>
+#include <cstdio>
+#include <iostream>
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <stdexcept>
+
+#include "device.h"
+
+namespace {
+
+std::atomic<bool> s_enabled(false);
+
+std::atomic<std::int64_t> s_time[kLoadPhaseCount];
+std::atomic<std::int64_t> s_memory[kLoadPhaseCount];
+std::atomic<std::size_t> s_count[kLoadPhaseCount];
+
+/// a thread stops recording after this many events, to bound the memory of long sessions
+const std::size_t s_maxTraceEvents = 1 << 20;
+
+struct TraceEvent {
+	const char* name;
+	std::chrono::steady_clock::time_point begin, end;
+};
+
+/// Events of a single thread, appended only by that thread
+struct TraceThread {
+	std::string name;
+	std::vector<TraceEvent> events;
+	std::size_t dropped = 0;
+};
+
+std::atomic<bool> s_tracing(false);
+std::chrono::steady_clock::time_point s_traceStart;
+
+/// buffers of all threads that recorded an event - never removed, so the pointers held by the threads stay valid
+std::mutex s_traceMutex;
+std::vector<std::unique_ptr<TraceThread>> s_traceThreads;
+
+/// the buffer of the calling thread, registered on its first use (the only locking on the recording path)
+TraceThread& traceThread() {
+	thread_local TraceThread* s_thread = nullptr;
+
+	if(s_thread == nullptr) {
+		std::lock_guard<std::mutex> lock(s_traceMutex);
+
+		s_traceThreads.push_back(std::unique_ptr<TraceThread>(new TraceThread()));
+		s_thread = s_traceThreads.back().get();
+	}
+
+	return *s_thread;
+}
+
+double microseconds(const std::chrono::steady_clock::time_point& t) {
+	return std::chrono::duration<double, std::micro>(t - s_traceStart).count();
+}
+
+}
+
+const char* loadPhaseName(LoadPhase phase) {
+	static const char* s_names[kLoadPhaseCount] = {"file_io", "parsing", "triangulation", "buffer_fill", "level_commit", "top_level_commit"};
+
+	assert(phase >= 0 && phase < kLoadPhaseCount);
+	return s_names[phase];
+}
+
+void setLoadProfiling(bool enabled) {
+	s_enabled = enabled;
+}
+
+void resetLoadProfile() {
+	for(int p = 0; p < kLoadPhaseCount; ++p) {
+		s_time[p] = 0;
+		s_memory[p] = 0;
+		s_count[p] = 0;
+	}
+}
+
+LoadPhaseTotals loadProfile(LoadPhase phase) {
+	assert(phase >= 0 && phase < kLoadPhaseCount);
+
+	LoadPhaseTotals result;
+	result.time = (double)s_time[phase] * 1e-9;
+	result.memory = s_memory[phase];
+	result.count = s_count[phase];
+
+	return result;
+}
+
+LoadPhaseScope::LoadPhaseScope(LoadPhase phase) : m_phase(phase), m_enabled(s_enabled), m_memory(0) {
+	if(m_enabled) {
+		m_memory = Device::memoryUsage();
+		m_start = std::chrono::steady_clock::now();
+	}
+}
+
+LoadPhaseScope::~LoadPhaseScope() {
+	if(m_enabled) {
+		s_time[m_phase] += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - m_start).count();
+		s_memory[m_phase] += (std::int64_t)Device::memoryUsage() - (std::int64_t)m_memory;
+		++s_count[m_phase];
+	}
+}
+
+void startTrace() {
+	{
+		std::lock_guard<std::mutex> lock(s_traceMutex);
+
+		for(auto& t : s_traceThreads) {
+			t->events.clear();
+			t->dropped = 0;
+		}
+	}
+
+	s_traceStart = std::chrono::steady_clock::now();
+	s_tracing = true;
+}
+
+void writeTrace(const boost::filesystem::path& path) {
+	s_tracing = false;
+
+	std::lock_guard<std::mutex> lock(s_traceMutex);
+
+	FILE* f = fopen(path.string().c_str(), "w");
+	if(f == nullptr)
+		throw std::runtime_error("cannot write trace file " + path.string());
+
+	fprintf(f, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+
+	bool first = true;
+	for(std::size_t tid = 0; tid < s_traceThreads.size(); ++tid) {
+		const TraceThread& thread = *s_traceThreads[tid];
+
+		const std::string name = thread.name.empty() ? "thread " + std::to_string(tid) : thread.name;
+		fprintf(f, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 0, \"tid\": %zu, \"args\": {\"name\": \"%s\"}}",
+		        first ? "" : ",\n", tid, name.c_str());
+		first = false;
+
+		for(auto& e : thread.events)
+			fprintf(f, ",\n{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 0, \"tid\": %zu, \"ts\": %.3f, \"dur\": %.3f}", e.name, tid,
+			        microseconds(e.begin), microseconds(e.end) - microseconds(e.begin));
+
+		if(thread.dropped > 0)
+			std::cerr << "Warning: " << thread.dropped << " trace events of " << name << " were dropped" << std::endl;
+	}
+
+	fprintf(f, "\n]}\n");
+	fclose(f);
+}
+
+void setTraceThreadName(const std::string& name) {
+	if(s_tracing)
+		traceThread().name = name;
+}
+
+TraceScope::TraceScope(const char* name) : m_name(name), m_enabled(s_tracing.load(std::memory_order_relaxed)) {
+	if(m_enabled)
+		m_start = std::chrono::steady_clock::now();
+}
+
+TraceScope::~TraceScope() {
+	if(m_enabled) {
+		TraceThread& thread = traceThread();
+
+		if(thread.events.size() < s_maxTraceEvents)
+			thread.events.push_back(TraceEvent{m_name, m_start, std::chrono::steady_clock::now()});
+		else
+			++thread.dropped;
+	}
+}
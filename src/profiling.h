@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <chrono>
+#include <string>
+
+#include <boost/noncopyable.hpp>
+#include <boost/filesystem/path.hpp>
+
+/// Phases of scene loading, measured across all loaders and threads while load profiling is enabled
+enum LoadPhase {
+	/// opening and mapping files, reading Alembic samples, and the binary mesh cache
+	kFileIO,
+	/// text and hierarchy parsing (OBJ, Alembic objects, glTF JSON)
+	kParsing,
+	/// counting, splitting and triangulating polygons
+	kTriangulation,
+	/// allocating Embree's buffers, filling them and attaching the geometries
+	kBufferFill,
+	/// commits of the scenes of all instancing levels but the top one
+	kLevelCommit,
+	kTopLevelCommit,
+
+	kLoadPhaseCount
+};
+
+/// Totals of a phase since the last reset
+struct LoadPhaseTotals {
+	/// time spent in the phase in seconds, summed over all threads - phases running in parallel can add up to more
+	/// than the wall time
+	double time = 0.0;
+	/// growth of Embree's memory usage during the phase, in bytes (including concurrent phases of other threads)
+	std::int64_t memory = 0;
+	/// number of times the phase was entered
+	std::size_t count = 0;
+};
+
+const char* loadPhaseName(LoadPhase phase);
+
+/// enables the measurement of load phases - while disabled (the default), LoadPhaseScope does nothing
+void setLoadProfiling(bool enabled);
+
+void resetLoadProfile();
+LoadPhaseTotals loadProfile(LoadPhase phase);
+
+/// Adds its lifetime to the totals of a load phase. Scopes are not nested - each one measures a leaf of the work.
+class LoadPhaseScope : public boost::noncopyable {
+	public:
+		LoadPhaseScope(LoadPhase phase);
+		~LoadPhaseScope();
+
+	private:
+		LoadPhase m_phase;
+		bool m_enabled;
+
+		std::chrono::steady_clock::time_point m_start;
+		std::size_t m_memory;
+};
+
+/// starts recording trace events (discarding previously recorded ones) - called before any traced work starts
+void startTrace();
+/// stops recording, and writes the recorded events in the Chrome Trace Event format (viewable in chrome://tracing or
+/// Perfetto) - called once all traced work has finished
+void writeTrace(const boost::filesystem::path& path);
+
+/// names the calling thread in the trace (threads are numbered otherwise)
+void setTraceThreadName(const std::string& name);
+
+/// Records its lifetime as a trace event of the calling thread. Events are appended to a buffer owned by the thread,
+/// without locking; while tracing is off, a scope only checks a flag. Scopes can be nested.
+class TraceScope : public boost::noncopyable {
+	public:
+		/// the name has to outlive the trace (e.g., a string literal)
+		TraceScope(const char* name);
+		~TraceScope();
+
+	private:
+		const char* m_name;
+		bool m_enabled;
+
+		std::chrono::steady_clock::time_point m_start;
+};
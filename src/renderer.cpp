@@ -1,137 +1,1219 @@
 #include "renderer.h"
 
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <limits>
+#include <functional>
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+
 #include <tbb/parallel_for.h>
+#include <tbb/task_arena.h>
+
+#include "profiling.h"
+#include "shading.h"
 
 #define TEXTURE_LEVELS 8
 #define TILE_SUBDIV 8
 
+namespace {
+
+/// the area of a tile of an image, split into TILE_SUBDIV x TILE_SUBDIV tiles
+SDL_Rect tileRect(int tileId, int w, int h) {
+	const int xMin = ((tileId % TILE_SUBDIV) * w) / TILE_SUBDIV;
+	const int xMax = ((tileId % TILE_SUBDIV + 1) * w) / TILE_SUBDIV;
+	const int yMin = ((tileId / TILE_SUBDIV) * h) / TILE_SUBDIV;
+	const int yMax = ((tileId / TILE_SUBDIV + 1) * h) / TILE_SUBDIV;
+
+	return SDL_Rect{xMin, yMin, xMax - xMin, yMax - yMin};
+}
+
+/// integer hash (lowbias32), used to seed per-pixel random sequences
+inline std::uint32_t hash(std::uint32_t x) {
+	x ^= x >> 16;
+	x *= 0x7feb352d;
+	x ^= x >> 15;
+	x *= 0x846ca68b;
+	x ^= x >> 16;
+	return x;
+}
+
+/// a random number in [0, 1), advancing the seed
+inline float random(std::uint32_t& seed) {
+	seed = hash(seed);
+	return (float)(seed >> 8) * (1.0f / 16777216.0f);
+}
+
+/// counts a worker in a gauge while it traces or shades a tile
+class ActiveWorker : public boost::noncopyable {
+	public:
+		ActiveWorker(std::atomic<int>& gauge) : m_gauge(gauge) {
+			++m_gauge;
+		}
+
+		~ActiveWorker() {
+			--m_gauge;
+		}
+
+	private:
+		std::atomic<int>& m_gauge;
+};
+
+/// true if two cameras have the same view
+bool sameView(const Camera& a, const Camera& b) {
+	return a.position.x == b.position.x && a.position.y == b.position.y && a.position.z == b.position.z &&
+	       a.target.x == b.target.x && a.target.y == b.target.y && a.target.z == b.target.z;
+}
+
+/// sine and cosine of an angle in [-pi, pi], folded to [-pi/2, pi/2] and approximated by Taylor polynomials (errors
+/// below 4e-6) - unlike std::sin and std::cos, it can be inlined and vectorized
+inline void sinCos(float x, float& s, float& c) {
+	const float a = std::abs(x);
+	const float r = std::copysign(std::min(a, (float)M_PI - a), x);
+	const float r2 = r * r;
+
+	s = r * (1.0f + r2 * (-1.0f / 6.0f + r2 * (1.0f / 120.0f + r2 * (-1.0f / 5040.0f + r2 * (1.0f / 362880.0f)))));
+	// the cosine is negative in the folded parts of the range
+	c = std::copysign(1.0f + r2 * (-0.5f + r2 * (1.0f / 24.0f + r2 * (-1.0f / 720.0f + r2 * (1.0f / 40320.0f + r2 * (-1.0f / 3628800.0f))))),
+	                  (float)M_PI * 0.5f - a);
+}
+
+/// a cosine-distributed direction on the hemisphere around a unit normal
+inline Vec3 cosineSample(const Vec3& n, float u1, float u2) {
+	// orthonormal basis (Duff et al. 2017)
+	const float sign = std::copysign(1.0f, n.z);
+	const float a = -1.0f / (sign + n.z);
+	const float b = n.x * n.y * a;
+	const Vec3 t(1.0f + sign * n.x * n.x * a, sign * b, -sign * n.x);
+	const Vec3 bt(b, sign + n.y * n.y * a, -n.y);
+
+	// the angle is uniform in [-pi, pi) rather than [0, 2 pi), which is the same distribution of directions
+	const float r = std::sqrt(u1);
+	float s, c;
+	sinCos(2.0f * (float)M_PI * (u2 - 0.5f), s, c);
+
+	return t * (r * c) + bt * (r * s) + n * std::sqrt(std::max(0.0f, 1.0f - u1));
+}
+
+/// copies an image between two buffers with different row pitches (in bytes)
+void copyRows(const Uint32* src, int srcPitch, Uint32* dest, int destPitch, int w, int h) {
+	for(int y = 0; y < h; ++y)
+		memcpy(dest + y * (destPitch / sizeof(Uint32)), src + y * (srcPitch / sizeof(Uint32)), w * sizeof(Uint32));
+}
+
+/// adds the value of a pass to its accumulated sum (if accumulating), returning the average of all passes so far
+inline float accumulate(float value, unsigned pass, float* accumulation, std::size_t index) {
+	if(accumulation == nullptr)
+		return value;
+
+	float& acc = accumulation[index];
+	acc += value;
+	return acc / (float)(pass + 1);
+}
+
+/// Paths of a path tracing wavefront, in structure-of-arrays layout to allow the per-path loops to vectorize
+struct Wavefront {
+	/// pixel (within the tile) each path contributes to, and its random sequence
+	std::vector<std::uint32_t> pixels, seeds;
+	std::vector<float> throughput;
+
+	/// last hit of each path, with the normal facing the incoming ray, and the direction of the next bounce
+	std::vector<float> px, py, pz;
+	std::vector<float> nx, ny, nz;
+	std::vector<float> dx, dy, dz;
+
+	std::size_t size() const {
+		return pixels.size();
+	}
+
+	void clear() {
+		for(auto v : {&pixels, &seeds})
+			v->clear();
+		for(auto v : {&throughput, &px, &py, &pz, &nx, &ny, &nz, &dx, &dy, &dz})
+			v->clear();
+	}
+
+	void push(std::uint32_t pixel, std::uint32_t seed, float t, const Vec3& p, const Vec3& n) {
+		pixels.push_back(pixel);
+		seeds.push_back(seed);
+		throughput.push_back(t);
+
+		px.push_back(p.x);
+		py.push_back(p.y);
+		pz.push_back(p.z);
+
+		nx.push_back(n.x);
+		ny.push_back(n.y);
+		nz.push_back(n.z);
+	}
+
+	void swap(Wavefront& w) {
+		pixels.swap(w.pixels);
+		seeds.swap(w.seeds);
+		throughput.swap(w.throughput);
+
+		px.swap(w.px);
+		py.swap(w.py);
+		pz.swap(w.pz);
+
+		nx.swap(w.nx);
+		ny.swap(w.ny);
+		nz.swap(w.nz);
+
+		dx.swap(w.dx);
+		dy.swap(w.dy);
+		dz.swap(w.dz);
+	}
+};
+
+/// The loop of scatter() - a separate function, as GCC relies on __restrict__ only for parameters (with local
+/// pointers, it can't prove that the arrays don't overlap, and doesn't vectorize the loop)
+void scatterPaths(std::size_t count, float bias, std::uint32_t* __restrict__ seeds,
+                  float* __restrict__ px, float* __restrict__ py, float* __restrict__ pz,
+                  const float* __restrict__ nx, const float* __restrict__ ny, const float* __restrict__ nz,
+                  float* __restrict__ dx, float* __restrict__ dy, float* __restrict__ dz) {
+	for(std::size_t i = 0; i < count; ++i) {
+		const float u1 = random(seeds[i]);
+		const float u2 = random(seeds[i]);
+
+		const Vec3 d = cosineSample(Vec3(nx[i], ny[i], nz[i]), u1, u2);
+		dx[i] = d.x;
+		dy[i] = d.y;
+		dz[i] = d.z;
+
+		px[i] += nx[i] * bias;
+		py[i] += ny[i] * bias;
+		pz[i] += nz[i] * bias;
+	}
+}
+
+/// Shading of all the paths of a wavefront - samples a diffuse bounce direction at each hit, and offsets its origin
+/// to avoid self-intersection. Branch-free over flat arrays - GCC's -fopt-info-vec reports its loop as vectorized at
+/// -O3 (which needs -fno-math-errno for std::sqrt, and the polynomial sinCos()).
+void scatter(Wavefront& wave, float bias) {
+	const std::size_t count = wave.size();
+	wave.dx.resize(count);
+	wave.dy.resize(count);
+	wave.dz.resize(count);
+
+	scatterPaths(count, bias, wave.seeds.data(), wave.px.data(), wave.py.data(), wave.pz.data(),
+	             wave.nx.data(), wave.ny.data(), wave.nz.data(), wave.dx.data(), wave.dy.data(), wave.dz.data());
+}
+
+/// Orders the rays of a wavefront by their direction octant and origin cell (using a counting sort), so that
+/// consecutive rays of the stream traverse similar parts of the scene
+void binRays(const Wavefront& wave, float cellSize, std::vector<std::uint32_t>& order) {
+	static const unsigned s_cellBits = 6;
+	static const unsigned s_binCount = 8 << s_cellBits;
+
+	const std::size_t count = wave.size();
+
+	std::vector<std::uint16_t> keys(count);
+	for(std::size_t i = 0; i < count; ++i) {
+		const unsigned octant = (wave.dx[i] < 0.0f) | ((wave.dy[i] < 0.0f) << 1) | ((wave.dz[i] < 0.0f) << 2);
+
+		// cells of a uniform grid, hashed into a small number of bins
+		const std::int32_t cx = (std::int32_t)std::floor(wave.px[i] / cellSize);
+		const std::int32_t cy = (std::int32_t)std::floor(wave.py[i] / cellSize);
+		const std::int32_t cz = (std::int32_t)std::floor(wave.pz[i] / cellSize);
+		const std::uint32_t cell = hash(cx * 73856093u ^ cy * 19349663u ^ cz * 83492791u);
+
+		keys[i] = (octant << s_cellBits) | (cell & ((1 << s_cellBits) - 1));
+	}
+
+	std::uint32_t offsets[s_binCount] = {0};
+	for(auto& k : keys)
+		++offsets[k];
+
+	std::uint32_t sum = 0;
+	for(auto& o : offsets) {
+		const std::uint32_t c = o;
+		o = sum;
+		sum += c;
+	}
+
+	order.resize(count);
+	for(std::size_t i = 0; i < count; ++i)
+		order[offsets[keys[i]]++] = i;
+}
+
+}
+
 Renderer::Renderer(const Scene& scene, SDL_Window* window, SDL_Renderer* renderer) : m_scene(&scene), m_window(window),
-	m_renderer(renderer), m_currentTexture(0), m_rendering(false) {
+	m_renderer(renderer), m_currentTexture(0), m_displayedTexture(-1), m_mode(kFacingRatio), m_reproject(false), m_projectedSize(0), m_rayCount(0), m_activeWorkers(0), m_pass(0), m_rendering(false),
+	m_busy(false), m_quit(false) {
 
 	m_textures.resize(TEXTURE_LEVELS);
+	m_framebuffers.resize(TEXTURE_LEVELS);
+	m_gbuffers.resize(TEXTURE_LEVELS);
 	initTextures();
+
+	m_readyEvent = SDL_RegisterEvents(1);
+	if(m_readyEvent == (Uint32)-1)
+		throw std::runtime_error("cannot register an SDL user event");
+
+	m_light = Vec3(0.3f, 1.0f, 0.2f);
+	m_light.normalize();
+
+	setAmbientOcclusion(AmbientOcclusion());
+	setPathTracing(PathTracing());
+
+	m_binSize = m_scene->size() / 8.0f;
 }
 
 Renderer::~Renderer() {
 	stopRenderThread();
 
-	for(auto& t : m_textures)
-		if(t->isLocked())
-			t->unlock();
+	if(m_thread.get() != nullptr) {
+		{
+			std::lock_guard<std::mutex> lock(m_threadMutex);
+			m_quit = true;
+		}
+		m_threadCondition.notify_all();
+
+		m_thread->join();
+	}
 }
 
 void Renderer::setCamera(Camera& cam) {
 	stopRenderThread();
 
+	// the finest completed level traced from the current view becomes the source of the reprojection (swapped, as the
+	// level is retraced anyway). A reprojected level which was not retraced yet (e.g., while dragging) is never used -
+	// reprojecting it again would accumulate its errors - so the last traced source is reused instead.
+	for(int level = m_currentTexture - 1; level >= 0; --level)
+		if(m_gbuffers[level].valid) {
+			std::swap(m_previous, m_gbuffers[level]);
+			break;
+		}
+	m_reproject = !m_previous.colors.empty();
+
 	m_camera = cam;
 
+	for(auto& g : m_gbuffers) {
+		g.valid = false;
+		std::fill(g.stale.begin(), g.stale.end(), 1);
+	}
+
+	startRenderThread();
+}
+
+void Renderer::setMode(Mode mode) {
+	stopRenderThread();
+
+	m_mode = mode;
+
+	// the previous image was shaded in a different mode
+	m_previous = GBuffer();
+
 	startRenderThread();
 }
 
+Renderer::Mode Renderer::mode() const {
+	return m_mode;
+}
+
+void Renderer::setLight(const Vec3& direction) {
+	// the other modes don't read the light (setMode() stops the render thread before it can), so their rendering and
+	// accumulated passes are kept
+	if(m_mode != kDirectionalLight) {
+		m_light = direction;
+		m_light.normalize();
+
+		return;
+	}
+
+	stopRenderThread();
+
+	m_light = direction;
+	m_light.normalize();
+
+	startRenderThread();
+}
+
+const Vec3& Renderer::light() const {
+	return m_light;
+}
+
+void Renderer::setAmbientOcclusion(const AmbientOcclusion& ao) {
+	stopRenderThread();
+
+	m_ao = ao;
+	m_ao.samples = std::max(m_ao.samples, 1u);
+	m_ao.passes = std::max(m_ao.passes, 1u);
+
+	const float size = m_scene->size();
+	m_aoDistance = ao.distance > 0.0f ? ao.distance : 0.1f * size;
+	m_aoBias = 1e-4f * size;
+}
+
+void Renderer::setPathTracing(const PathTracing& pt) {
+	stopRenderThread();
+
+	m_pt = pt;
+	m_pt.bounces = std::max(m_pt.bounces, 1u);
+	m_pt.passes = std::max(m_pt.passes, 1u);
+}
+
 void Renderer::resize(std::size_t /*w*/, std::size_t /*h*/) {
 	initTextures();
 
 	startRenderThread();
 }
 
-SDL_Texture* Renderer::texture() {
-	assert(m_currentTexture > 0);
+bool Renderer::update() {
+	if(!m_frames.consume())
+		return false;
+
+	TraceScope scope("Renderer::update");
+
+	const Frame& frame = m_frames.front();
+	if(frame.level < 0)
+		return false;
+
+	// a frame rendered before the last resize
+	Texture& texture = *m_textures[frame.level];
+	if(frame.image.width() != texture.width() || frame.image.height() != texture.height())
+		return false;
+
+	// each run of dirty tiles in a row of tiles is uploaded as one rectangle
+	for(int row = 0; row < TILE_SUBDIV; ++row)
+		for(int x = 0; x < TILE_SUBDIV; ) {
+			if(!frame.dirty[row * TILE_SUBDIV + x]) {
+				++x;
+				continue;
+			}
 
-	const int current = m_currentTexture-1;
+			const int first = x;
+			while(x < TILE_SUBDIV && frame.dirty[row * TILE_SUBDIV + x])
+				++x;
 
-	if(m_textures[current]->isLocked())
-		m_textures[current]->unlock();
+			SDL_Rect rect = tileRect(row * TILE_SUBDIV + first, texture.width(), texture.height());
+			const SDL_Rect last = tileRect(row * TILE_SUBDIV + x - 1, texture.width(), texture.height());
+			rect.w = last.x + last.w - rect.x;
 
-	return m_textures[current]->texture();
+			if(!SDL_RectEmpty(&rect)) {
+				const Uint32* pixels = frame.image.pixels() + rect.y * (frame.image.pitch() / sizeof(Uint32)) + rect.x;
+				SDL_UpdateTexture(texture.texture(), &rect, pixels, frame.image.pitch());
+			}
+		}
+
+	if(!frame.complete)
+		return false;
+
+	m_displayedTexture = frame.level;
+
+	return true;
+}
+
+SDL_Texture* Renderer::texture() {
+	assert(m_displayedTexture >= 0);
+
+	return m_textures[m_displayedTexture]->texture();
 }
 
 int Renderer::currentTexture() const {
-	return m_currentTexture - 1;
+	return m_displayedTexture;
+}
+
+int Renderer::currentPass() const {
+	return m_pass;
+}
+
+bool Renderer::pick(const Camera& camera, int x, int y, int w, int h, Hit& hit) const {
+	std::lock_guard<std::mutex> lock(m_idsMutex);
+
+	if(!m_ids.valid || !sameView(camera, m_ids.camera) || w <= 0 || h <= 0)
+		return false;
+
+	// the pixel of the (possibly coarser) level covering the window pixel
+	const int px = std::min(std::max(x, 0) * m_ids.width / w, m_ids.width - 1);
+	const int py = std::min(std::max(y, 0) * m_ids.height / h, m_ids.height - 1);
+	const std::size_t index = (std::size_t)py * m_ids.width + px;
+
+	hit.distance = m_ids.distances[index];
+	hit.geomID = m_ids.geomIDs[index];
+	for(unsigned l = 0; l < RTC_MAX_INSTANCE_LEVEL_COUNT; ++l)
+		hit.instID[l] = m_ids.instIDs[index * RTC_MAX_INSTANCE_LEVEL_COUNT + l];
+
+	return true;
+}
+
+void Renderer::publishIds(const GBuffer& gbuffer) {
+	std::lock_guard<std::mutex> lock(m_idsMutex);
+
+	// copied into the reserved storage, so that both the G-buffer and the ID buffer keep their sizes
+	m_ids.width = gbuffer.width;
+	m_ids.height = gbuffer.height;
+	m_ids.camera = m_camera;
+	m_ids.distances.assign(gbuffer.distances.begin(), gbuffer.distances.end());
+	m_ids.geomIDs.assign(gbuffer.geomIDs.begin(), gbuffer.geomIDs.end());
+	m_ids.instIDs.assign(gbuffer.instIDs.begin(), gbuffer.instIDs.end());
+	m_ids.valid = true;
+}
+
+Renderer::Statistics Renderer::statistics() const {
+	std::lock_guard<std::mutex> lock(m_statisticsMutex);
+
+	Statistics result = m_statistics;
+	result.activeThreads = m_activeWorkers;
+	result.threads = tbb::this_task_arena::max_concurrency();
+
+	return result;
+}
+
+void Renderer::recordTime(float& time, const std::chrono::steady_clock::time_point& start, std::uint64_t rays) {
+	const std::chrono::duration<float, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+	std::lock_guard<std::mutex> lock(m_statisticsMutex);
+
+	time = elapsed.count();
+	if(elapsed.count() > 0.0f)
+		m_statistics.raysPerSecond = (double)(m_rayCount - rays) / (elapsed.count() * 1e-3);
+}
+
+Uint32 Renderer::readyEvent() const {
+	return m_readyEvent;
+}
+
+void Renderer::publish(int level, int tile, bool last) {
+	const Framebuffer& framebuffer = *m_framebuffers[level];
+	const int w = framebuffer.width();
+	const int h = framebuffer.height();
+
+	Frame& frame = m_frames.back();
+	if(frame.level != level || frame.image.width() != w || frame.image.height() != h) {
+		frame.image.resize(w, h);
+		frame.level = level;
+		frame.dirty.assign(TILE_SUBDIV * TILE_SUBDIV, false);
+	}
+
+	// the tiles of a level are only shown once it is complete, except for the passes refining a complete image
+	frame.complete = last || level < m_currentTexture;
+
+	if(tile >= 0) {
+		frame.dirty[tile] = true;
+		frame.image.copy(framebuffer, tileRect(tile, w, h));
+	}
+
+	if(m_frames.pending()) {
+		// the tiles are accumulated in the back buffer until the main thread catches up
+		if(!last)
+			return;
+
+		// the last frame is always published, replacing the pending one - which then becomes the back buffer, and
+		// might hold tiles missing from this frame
+		tile = -1;
+	}
+
+	if(tile < 0) {
+		frame.dirty.assign(TILE_SUBDIV * TILE_SUBDIV, true);
+		frame.image.copy(framebuffer, SDL_Rect{0, 0, w, h});
+	}
+
+	m_frames.publish();
+
+	// the new back buffer was either uploaded already, or replaced by a frame with all its tiles
+	m_frames.back().level = -1;
+
+	notifyReady();
+}
+
+void Renderer::notifyReady() {
+	// SDL_PushEvent is thread-safe, and wakes up the main loop waiting for events
+	SDL_Event event;
+	SDL_zero(event);
+	event.type = m_readyEvent;
+	SDL_PushEvent(&event);
 }
 
 void Renderer::startRenderThread() {
 	stopRenderThread();
 
 	m_currentTexture = 0;
-	m_rendering = true;
 
-	for(auto& t : m_textures)
-		t->lock();
+	// tiles accumulated for the main thread are from the previous view (the render thread is idle)
+	m_frames.back().level = -1;
+
+	for(std::size_t level = 0; level < m_textures.size(); ++level) {
+		GBuffer& gbuffer = m_gbuffers[level];
 
-	std::function<void()> renderFunctor(std::bind(&Renderer::renderAll, this));
-	m_thread = std::unique_ptr<std::thread>(new std::thread(renderFunctor));
+		const int w = m_textures[level]->width();
+		const int h = m_textures[level]->height();
+		if(gbuffer.width != w || gbuffer.height != h) {
+			gbuffer.width = w;
+			gbuffer.height = h;
+			gbuffer.positions.resize(w * h);
+			gbuffer.normals.resize(w * h);
+			gbuffer.colors.resize(w * h);
+			gbuffer.distances.resize(w * h);
+			gbuffer.geomIDs.resize(w * h);
+			gbuffer.instIDs.resize(w * h * RTC_MAX_INSTANCE_LEVEL_COUNT);
+			gbuffer.stale.assign(w * h, 1);
+			gbuffer.valid = false;
+		}
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_statisticsMutex);
+		m_statistics.levelTimes.assign(m_textures.size(), 0.0f);
+		m_statistics.passTime = 0.0f;
+		m_statistics.reprojectionTime = 0.0f;
+	}
+
+	m_pass = 0;
+	m_accumulation.assign(m_textures.back()->width() * m_textures.back()->height(), 0.0f);
+
+	{
+		std::lock_guard<std::mutex> lock(m_threadMutex);
+		m_rendering = true;
+		m_busy = true;
+
+		if(m_thread.get() == nullptr) {
+			std::function<void()> renderFunctor(std::bind(&Renderer::renderLoop, this));
+			m_thread = std::unique_ptr<std::thread>(new std::thread(renderFunctor));
+		}
+	}
+	m_threadCondition.notify_all();
 }
 
 void Renderer::stopRenderThread() {
+	std::unique_lock<std::mutex> lock(m_threadMutex);
+
 	m_rendering = false;
-	if(m_thread.get() != nullptr)
-		m_thread->join();
-	m_thread.reset();
+	m_threadCondition.wait(lock, [this]() {
+		return !m_busy;
+	});
+}
+
+void Renderer::renderLoop() {
+	setTraceThreadName("render");
+
+	std::unique_lock<std::mutex> lock(m_threadMutex);
+
+	while(true) {
+		m_threadCondition.wait(lock, [this]() {
+			return m_busy || m_quit;
+		});
+
+		if(m_quit)
+			break;
+
+		lock.unlock();
+		renderAll();
+		lock.lock();
+
+		m_busy = false;
+		m_threadCondition.notify_all();
+	}
 }
 
 void Renderer::renderAll() {
 	auto format = *SDL_GetWindowSurface(m_window)->format;
+
+	// a new camera view starts from the reprojected previous view, instead of the coarsest level
+	if(m_reproject) {
+		m_reproject = false;
+		reproject(format);
+	}
+
 	while(m_rendering && m_currentTexture < (int)m_textures.size())
 		renderFrame(format);
-}
 
-Ray Renderer::cameraRay(int x, int y, int w, int h) const {
-	const float xf = ((float)x / (float)w - 0.5f) * 2.0f;
-	const float yf = ((float)y / (float)h - 0.5f) * 2.0f;
-	const float aspect = (float)w / (float)h;
+	// progressive refinement of the full-resolution image (including its first exact pass after a reprojection)
+	while(m_rendering && m_pass < (int)passCount())
+		renderPass(format);
+}
 
-	return m_camera.makeRay(xf, -yf / aspect);
+unsigned Renderer::passCount() const {
+	switch(m_mode) {
+		case kAmbientOcclusion:
+			return m_ao.passes;
+		case kPathTracing:
+			return m_pt.passes;
+		default:
+			return 1;
+	}
 }
 
 void Renderer::renderFrame(SDL_PixelFormat format) {
+	TraceScope scope("Renderer::renderFrame");
+
 	if(m_currentTexture < (int)m_textures.size() && m_rendering) {
-		assert(m_textures[m_currentTexture]->isLocked());
+		Framebuffer& framebuffer = *m_framebuffers[m_currentTexture];
+
+		const int w = framebuffer.width();
+		const int h = framebuffer.height();
+		const int pitch = framebuffer.pitch();
+		Uint32* pixels = framebuffer.pixels();
+
+		// the full-resolution level is the first pass of the accumulated image
+		const bool accumulate = m_currentTexture + 1 == (int)m_textures.size();
+
+		// primary hits are kept between frames, and retraced only when the camera changes
+		GBuffer& gbuffer = m_gbuffers[m_currentTexture];
+		const bool trace = !gbuffer.valid;
 
-		const int w = m_textures[m_currentTexture]->width();
-		const int h = m_textures[m_currentTexture]->height();
-		const int pitch = m_textures[m_currentTexture]->pitch();
-		Uint32* pixels = m_textures[m_currentTexture]->pixels();
+		const int level = m_currentTexture;
+		int completed = 0;
+
+		const auto start = std::chrono::steady_clock::now();
+		const std::uint64_t rays = m_rayCount;
 
 		//for(int tileId = 0; tileId < TILE_SUBDIV*TILE_SUBDIV; ++tileId) {
-		tbb::parallel_for(0, TILE_SUBDIV * TILE_SUBDIV, [this, &w, &h, &pixels, &pitch, &format](int tileId) {
+		tbb::parallel_for(0, TILE_SUBDIV * TILE_SUBDIV, [this, &w, &h, &pixels, &pitch, &format, &gbuffer, accumulate, trace, level,
+		                                                 &completed](int tileId) {
 			const int xMin = ((tileId % TILE_SUBDIV) * w) / TILE_SUBDIV;
 			const int xMax = ((tileId % TILE_SUBDIV + 1) * w) / TILE_SUBDIV;
 			const int yMin = ((tileId / TILE_SUBDIV) * h) / TILE_SUBDIV;
 			const int yMax = ((tileId / TILE_SUBDIV + 1) * h) / TILE_SUBDIV;
 
-			renderTile(xMin, xMax, yMin, yMax, pixels, pitch, w, h, format);
+			if(trace)
+				traceTile(gbuffer, xMin, xMax, yMin, yMax);
+
+			shadeTile(gbuffer, xMin, xMax, yMin, yMax, pixels, pitch, format, 0, accumulate ? m_accumulation.data() : nullptr);
+
+			// each tile is uploaded as soon as it is complete, the level is shown with its last one
+			if(m_rendering) {
+				// includes waiting for the other tiles' publishing
+				TraceScope scope("publish");
+
+				std::lock_guard<std::mutex> lock(m_publishMutex);
+				publish(level, tileId, ++completed == TILE_SUBDIV * TILE_SUBDIV);
+			}
 		});
 		//}
 
-		if(m_rendering)
+		if(m_rendering) {
+			if(trace) {
+				gbuffer.valid = true;
+				publishIds(gbuffer);
+			}
+
+			copyRows(pixels, pitch, gbuffer.colors.data(), w * sizeof(Uint32), w, h);
+
+			if(accumulate)
+				m_pass = 1;
+
+			recordTime(m_statistics.levelTimes[level], start, rays);
+
 			++m_currentTexture;
+		}
 	}
 	else
 		m_rendering = false;
 }
 
-void Renderer::renderTile(int xMin, int xMax, int yMin, int yMax, Uint32* pixels, int pitch, int w, int h, SDL_PixelFormat format) {
-	for(int y = yMin; y < yMax && m_rendering; ++y)
-		for(int x = xMin; x < xMax && m_rendering; ++x) {
-			const Vec3 color = m_scene->renderPixel(cameraRay(x, y, w, h));
+void Renderer::shadeTile(const GBuffer& gbuffer, int xMin, int xMax, int yMin, int yMax, Uint32* pixels, int pitch, SDL_PixelFormat format,
+                         unsigned pass, float* accumulation) {
+	TraceScope scope("shadeTile");
+	const ActiveWorker worker(m_activeWorkers);
+
+	if(m_mode == kAmbientOcclusion)
+		renderTileAO(gbuffer, xMin, xMax, yMin, yMax, pixels, pitch, format, pass, accumulation);
+	else if(m_mode == kPathTracing)
+		renderTilePath(gbuffer, xMin, xMax, yMin, yMax, pixels, pitch, format, pass, accumulation);
+	else if(m_mode == kDirectionalLight)
+		renderTileLight(gbuffer, xMin, xMax, yMin, yMax, pixels, pitch, format);
+	else
+		renderTileFacing(gbuffer, xMin, xMax, yMin, yMax, pixels, pitch, format);
+}
+
+void Renderer::renderTileFacing(const GBuffer& gbuffer, int xMin, int xMax, int yMin, int yMax, Uint32* pixels, int pitch, SDL_PixelFormat format) {
+	const int w = gbuffer.width;
+
+	for(int y = yMin; y < yMax; ++y)
+		for(int x = xMin; x < xMax; ++x) {
+			const float value = facingRatio(m_camera.position, gbuffer.positions[y * w + x], gbuffer.normals[y * w + x]);
+			pixels[y * (pitch / sizeof(Uint32)) + x] = packGray(value, format);
+		}
+}
+
+void Renderer::traceTile(GBuffer& gbuffer, int xMin, int xMax, int yMin, int yMax) {
+	TraceScope scope("traceTile");
+	const ActiveWorker worker(m_activeWorkers);
+
+	const int w = gbuffer.width;
+	const int h = gbuffer.height;
+	const std::size_t tileWidth = xMax - xMin;
+
+	// primary rays of the whole tile, traced as a single coherent stream
+	std::vector<RTCRayHit> primary;
+	tracePrimaryTile(*m_scene, m_camera, w, h, xMin, xMax, yMin, yMax, primary);
+	m_rayCount += primary.size();
+
+	if(!m_rendering)
+		return;
+
+	writePrimaryHits(*m_scene, primary, w, xMin, xMax, yMin, gbuffer.positions.data(), gbuffer.normals.data());
+
+	for(std::size_t i = 0; i < primary.size(); ++i) {
+		const RTCRayHit& rayhit = primary[i];
+		const std::size_t index = (yMin + i / tileWidth) * w + xMin + i % tileWidth;
+
+		gbuffer.stale[index] = 0;
+		gbuffer.distances[index] = rayhit.ray.tfar;
+		gbuffer.geomIDs[index] = rayhit.hit.geomID;
+		for(unsigned l = 0; l < RTC_MAX_INSTANCE_LEVEL_COUNT; ++l)
+			gbuffer.instIDs[index * RTC_MAX_INSTANCE_LEVEL_COUNT + l] =
+				rayhit.hit.geomID == RTC_INVALID_GEOMETRY_ID ? RTC_INVALID_GEOMETRY_ID : rayhit.hit.instID[l];
+	}
+}
+
+void Renderer::renderTileAO(const GBuffer& gbuffer, int xMin, int xMax, int yMin, int yMax, Uint32* pixels, int pitch, SDL_PixelFormat format,
+                            unsigned pass, float* accumulation) {
+	const int w = gbuffer.width;
+
+	// occlusion rays of all hits, cosine-distributed around the normal, traced as a single incoherent stream
+	std::vector<RTCRay> occlusion;
+	occlusion.reserve((xMax - xMin) * (yMax - yMin) * m_ao.samples);
+
+	for(int y = yMin; y < yMax; ++y)
+		for(int x = xMin; x < xMax; ++x) {
+			const Vec3& norm = gbuffer.normals[y * w + x];
+			if(!hasHit(norm))
+				continue;
+
+			std::uint32_t seed = hash(y * w + x) ^ hash(pass + 0x9e3779b9);
+
+			for(unsigned s = 0; s < m_ao.samples; ++s) {
+				const float u1 = random(seed);
+				const float u2 = random(seed);
+
+				occlusion.emplace_back();
+				initRay(occlusion.back(), gbuffer.positions[y * w + x] + norm * m_aoBias, cosineSample(norm, u1, u2), m_aoDistance);
+			}
+		}
+
+	m_scene->occluded(occlusion.data(), occlusion.size());
+	m_rayCount += occlusion.size();
+
+	if(!m_rendering)
+		return;
+
+	auto ray = occlusion.begin();
+	for(int y = yMin; y < yMax; ++y)
+		for(int x = xMin; x < xMax; ++x) {
+			float value = 0.0f;
+
+			if(hasHit(gbuffer.normals[y * w + x])) {
+				unsigned unoccluded = 0;
+				for(unsigned s = 0; s < m_ao.samples; ++s, ++ray)
+					if(ray->tfar >= 0.0f)
+						++unoccluded;
+
+				value = (float)unoccluded / (float)m_ao.samples;
+			}
+
+			value = accumulate(value, pass, accumulation, y * w + x);
+
+			pixels[y * (pitch / sizeof(Uint32)) + x] = packGray(value, format);
+		}
+}
+
+void Renderer::renderTileLight(const GBuffer& gbuffer, int xMin, int xMax, int yMin, int yMax, Uint32* pixels, int pitch, SDL_PixelFormat format) {
+	static const float s_ambient = 0.1f;
 
-			Uint32 rgb = SDL_MapRGBA(&format, (Uint8)(color.x * 255.0), (Uint8)(color.y * 255.0),
-			                         (Uint8)(color.z * 255.0), 255);
-			Uint32 pixelPosition = y * (pitch / sizeof(Uint32)) + x;
-			pixels[pixelPosition] = rgb;
+	const int w = gbuffer.width;
+
+	// shadow rays of all lit hits - all parallel, so traced as a single coherent stream
+	std::vector<RTCRay> shadow;
+	shadow.reserve((xMax - xMin) * (yMax - yMin));
+
+	for(int y = yMin; y < yMax; ++y)
+		for(int x = xMin; x < xMax; ++x) {
+			const Vec3& norm = gbuffer.normals[y * w + x];
+			if(hasHit(norm) && norm.dot(m_light) > 0.0f) {
+				shadow.emplace_back();
+				initRay(shadow.back(), gbuffer.positions[y * w + x] + norm * m_aoBias, m_light, std::numeric_limits<float>::infinity());
+			}
+		}
+
+	m_scene->occluded(shadow.data(), shadow.size(), true);
+	m_rayCount += shadow.size();
+
+	if(!m_rendering)
+		return;
+
+	auto ray = shadow.begin();
+	for(int y = yMin; y < yMax; ++y)
+		for(int x = xMin; x < xMax; ++x) {
+			const Vec3& norm = gbuffer.normals[y * w + x];
+
+			float value = 0.0f;
+			if(hasHit(norm)) {
+				value = s_ambient;
+
+				const float cosTheta = norm.dot(m_light);
+				if(cosTheta > 0.0f) {
+					if(ray->tfar >= 0.0f)
+						value += (1.0f - s_ambient) * cosTheta;
+					++ray;
+				}
+			}
+
+			pixels[y * (pitch / sizeof(Uint32)) + x] = packGray(value, format);
 		}
 }
 
+void Renderer::renderTilePath(const GBuffer& gbuffer, int xMin, int xMax, int yMin, int yMax, Uint32* pixels, int pitch, SDL_PixelFormat format,
+                              unsigned pass, float* accumulation) {
+	const int w = gbuffer.width;
+	const int tileWidth = xMax - xMin;
+
+	std::vector<float> radiance(tileWidth * (yMax - yMin), 0.0f);
+
+	// the paths start at the primary hits of the G-buffer
+	Wavefront wave;
+	for(int y = yMin; y < yMax; ++y)
+		for(int x = xMin; x < xMax; ++x) {
+			const Vec3& norm = gbuffer.normals[y * w + x];
+			if(hasHit(norm))
+				wave.push((y - yMin) * tileWidth + (x - xMin), hash(y * w + x) ^ hash(pass + 0x9e3779b9), m_pt.albedo,
+				          gbuffer.positions[y * w + x], norm);
+		}
+
+	// each bounce of all the paths of the tile is traced as a single stream - binning the rays by direction and origin
+	// keeps the traversal of consecutive rays in similar parts of the scene, but the bounces are still incoherent
+	Wavefront next;
+	std::vector<std::uint32_t> order;
+	std::vector<RTCRayHit> rays;
+	std::vector<Vec3> geometric, shading;
+
+	for(unsigned bounce = 0; bounce < m_pt.bounces && wave.size() > 0; ++bounce) {
+		scatter(wave, m_aoBias);
+		binRays(wave, m_binSize, order);
+
+		rays.resize(wave.size());
+		for(std::size_t i = 0; i < rays.size(); ++i) {
+			const std::uint32_t p = order[i];
+
+			initRay(rays[i].ray, Vec3(wave.px[p], wave.py[p], wave.pz[p]), Vec3(wave.dx[p], wave.dy[p], wave.dz[p]),
+			        std::numeric_limits<float>::infinity());
+			rays[i].hit.geomID = RTC_INVALID_GEOMETRY_ID;
+			rays[i].hit.instID[0] = RTC_INVALID_GEOMETRY_ID;
+		}
+
+		m_scene->intersect(rays.data(), rays.size(), false);
+		m_rayCount += rays.size();
+
+		if(!m_rendering)
+			return;
+
+		// the binned rays mostly hit the same instance as their predecessor
+		geometric.resize(rays.size());
+		shading.resize(rays.size());
+		m_scene->worldNormals(rays.data(), rays.size(), geometric.data(), shading.data());
+
+		// compaction - escaped paths gather the (white) sky's radiance, the others continue from their hits
+		next.clear();
+		for(std::size_t i = 0; i < rays.size(); ++i) {
+			const RTCRayHit& rayhit = rays[i];
+			const std::uint32_t p = order[i];
+
+			if(rayhit.hit.geomID == RTC_INVALID_GEOMETRY_ID)
+				radiance[wave.pixels[p]] += wave.throughput[p];
+
+			else {
+				const Vec3 dir(rayhit.ray.dir_x, rayhit.ray.dir_y, rayhit.ray.dir_z);
+
+				Vec3 norm = shading[i];
+				if(geometric[i].dot(dir) > 0.0f)
+					norm = norm * -1.0f;
+
+				next.push(wave.pixels[p], wave.seeds[p], wave.throughput[p] * m_pt.albedo,
+				          Vec3(rayhit.ray.org_x, rayhit.ray.org_y, rayhit.ray.org_z) + dir * rayhit.ray.tfar, norm);
+			}
+		}
+
+		wave.swap(next);
+	}
+
+	for(int y = yMin; y < yMax; ++y)
+		for(int x = xMin; x < xMax; ++x) {
+			const float value = accumulate(radiance[(y - yMin) * tileWidth + (x - xMin)], pass, accumulation, y * w + x);
+
+			pixels[y * (pitch / sizeof(Uint32)) + x] = packGray(value, format);
+		}
+}
+
+void Renderer::renderPass(SDL_PixelFormat format) {
+	TraceScope scope("Renderer::renderPass");
+
+	Framebuffer& framebuffer = *m_framebuffers.back();
+
+	const int w = framebuffer.width();
+	const int h = framebuffer.height();
+	const int pitch = framebuffer.pitch();
+	Uint32* pixels = framebuffer.pixels();
+	const unsigned pass = m_pass;
+
+	// after a reprojection, the first pass also retraces the primary hits
+	GBuffer& gbuffer = m_gbuffers.back();
+	const bool trace = !gbuffer.valid;
+
+	const int level = m_framebuffers.size() - 1;
+	int completed = 0;
+
+	const auto start = std::chrono::steady_clock::now();
+	const std::uint64_t rays = m_rayCount;
+
+	// after a reprojection, the tiles with the most reprojected (stale) pixels are retraced first, and the tiles
+	// traced completely by the reprojection are only shaded
+	std::vector<std::size_t> staleCounts(TILE_SUBDIV * TILE_SUBDIV, 0);
+	if(trace)
+		tbb::parallel_for(0, TILE_SUBDIV * TILE_SUBDIV, [&](int tileId) {
+			const SDL_Rect rect = tileRect(tileId, w, h);
+			for(int y = rect.y; y < rect.y + rect.h; ++y)
+				staleCounts[tileId] += std::count(gbuffer.stale.begin() + y * w + rect.x, gbuffer.stale.begin() + y * w + rect.x + rect.w, 1);
+		});
+
+	std::vector<int> order(TILE_SUBDIV * TILE_SUBDIV);
+	std::iota(order.begin(), order.end(), 0);
+	std::stable_sort(order.begin(), order.end(), [&staleCounts](int a, int b) {
+		return staleCounts[a] > staleCounts[b];
+	});
+
+	// each task takes the next tile in this order, whichever part of the range the scheduler gave it
+	std::atomic<int> next(0);
+
+	tbb::parallel_for(0, TILE_SUBDIV * TILE_SUBDIV, [this, w, h, pass, pixels, pitch, &format, &gbuffer, trace, level, &completed,
+	                                                 &order, &staleCounts, &next](int) {
+		const int tileId = order[next++];
+
+		const int xMin = ((tileId % TILE_SUBDIV) * w) / TILE_SUBDIV;
+		const int xMax = ((tileId % TILE_SUBDIV + 1) * w) / TILE_SUBDIV;
+		const int yMin = ((tileId / TILE_SUBDIV) * h) / TILE_SUBDIV;
+		const int yMax = ((tileId / TILE_SUBDIV + 1) * h) / TILE_SUBDIV;
+
+		if(trace && staleCounts[tileId] > 0)
+			traceTile(gbuffer, xMin, xMax, yMin, yMax);
+
+		shadeTile(gbuffer, xMin, xMax, yMin, yMax, pixels, pitch, format, pass, m_accumulation.data());
+
+		// the tiles of a pass replace those of the previous one as they complete
+		if(m_rendering) {
+			TraceScope scope("publish");
+
+			std::lock_guard<std::mutex> lock(m_publishMutex);
+			publish(level, tileId, ++completed == TILE_SUBDIV * TILE_SUBDIV);
+		}
+	});
+
+	// an interrupted pass leaves the accumulation buffer inconsistent, but it is reset on restart anyway
+	if(m_rendering) {
+		if(trace) {
+			gbuffer.valid = true;
+			publishIds(gbuffer);
+		}
+
+		copyRows(pixels, pitch, gbuffer.colors.data(), w * sizeof(Uint32), w, h);
+
+		recordTime(m_statistics.passTime, start, rays);
+
+		++m_pass;
+	}
+}
+
+void Renderer::reproject(SDL_PixelFormat format) {
+	static const int s_holeTileSize = 16;
+
+	TraceScope scope("Renderer::reproject");
+
+	const auto start = std::chrono::steady_clock::now();
+	const std::uint64_t rays = m_rayCount;
+
+	const int level = m_textures.size() - 1;
+	GBuffer& gbuffer = m_gbuffers[level];
+	const GBuffer& previous = m_previous;
+
+	const int w = gbuffer.width;
+	const int h = gbuffer.height;
+	const int pitch = m_framebuffers[level]->pitch();
+	Uint32* pixels = m_framebuffers[level]->pixels();
+
+	// each pixel of a coarser previous level covers a block of pixels
+	const int scale = std::max((w + previous.width - 1) / std::max(previous.width, 1), 1);
+
+	Vec3 fwd, side, up;
+	m_camera.basis(fwd, side, up);
+	const float aspect = (float)w / (float)h;
+
+	// only the traced holes are exact - all the other pixels are retraced by the next pass, the most stale tiles first
+	std::fill(gbuffer.stale.begin(), gbuffer.stale.end(), 1);
+
+	// the scratch buffers are reallocated only when the size changes
+	if(m_projectedSize != gbuffer.colors.size()) {
+		m_projectedSize = gbuffer.colors.size();
+		m_projected.reset(new std::atomic<std::uint64_t>[m_projectedSize]);
+		m_depth[0].resize(m_projectedSize);
+		m_depth[1].resize(m_projectedSize);
+	}
+
+	static const std::uint64_t s_empty = std::numeric_limits<std::uint64_t>::max();
+
+	tbb::parallel_for(0, h, [&](int y) {
+		for(int x = 0; x < w; ++x)
+			m_projected[y * w + x].store(s_empty, std::memory_order_relaxed);
+	});
+
+	// forward projection of all the previous hits (the inverse of Camera::pixelRay), keeping the closest one in each
+	// pixel. The bits of a positive float are ordered like its value, so with the distance in the upper half of a key,
+	// the atomic minimum picks the closest sample (the source index in the lower half breaks the ties).
+	tbb::parallel_for(std::size_t(0), previous.normals.size(), [&](std::size_t i) {
+		if(!hasHit(previous.normals[i]))
+			return;
+
+		const Vec3 v = previous.positions[i] - m_camera.position;
+		const float d = v.dot(fwd);
+		if(d <= 0.0f)
+			return;
+
+		const float xf = -v.dot(side) / d;
+		const float yf = -v.dot(up) / d * aspect;
+		const int x0 = (int)std::floor((xf * 0.5f + 0.5f) * w + 0.5f);
+		const int y0 = (int)std::floor((yf * 0.5f + 0.5f) * h + 0.5f);
+
+		const float distance = v.length();
+		std::uint32_t bits;
+		std::memcpy(&bits, &distance, sizeof(bits));
+		const std::uint64_t key = ((std::uint64_t)bits << 32) | (std::uint64_t)i;
+
+		for(int y = std::max(y0, 0); y < std::min(y0 + scale, h); ++y)
+			for(int x = std::max(x0, 0); x < std::min(x0 + scale, w); ++x) {
+				std::atomic<std::uint64_t>& target = m_projected[y * w + x];
+
+				std::uint64_t current = target.load(std::memory_order_relaxed);
+				while(key < current && !target.compare_exchange_weak(current, key, std::memory_order_relaxed))
+					;
+			}
+	});
+
+	// the closest samples are copied to the G-buffer
+	std::vector<float>* depth = &m_depth[0];
+	tbb::parallel_for(0, h, [&](int y) {
+		for(int x = 0; x < w; ++x) {
+			const int index = y * w + x;
+			const std::uint64_t key = m_projected[index].load(std::memory_order_relaxed);
+
+			if(key == s_empty) {
+				(*depth)[index] = std::numeric_limits<float>::infinity();
+				gbuffer.normals[index] = Vec3(0, 0, 0);
+				continue;
+			}
+
+			const std::size_t source = key & 0xffffffff;
+			const std::uint32_t bits = key >> 32;
+			std::memcpy(&(*depth)[index], &bits, sizeof(bits));
+			gbuffer.positions[index] = previous.positions[source];
+			gbuffer.normals[index] = previous.normals[source];
+			gbuffer.colors[index] = previous.colors[source];
+		}
+	});
+
+	// cracks between the projected samples (mostly surrounded by projected pixels) are filled from their closest
+	// neighbour. Each iteration reads the depths of the previous one and writes all the depths of the other buffer,
+	// and writes the G-buffer only in pixels which were not covered before, so its rows can be filled in parallel.
+	for(int iteration = 0; iteration < 2; ++iteration) {
+		const std::vector<float>& covered = *depth;
+		std::vector<float>& filled = m_depth[depth == &m_depth[0] ? 1 : 0];
+
+		tbb::parallel_for(0, h, [&](int y) {
+			for(int x = 0; x < w; ++x) {
+				const int index = y * w + x;
+				filled[index] = covered[index];
+
+				if(covered[index] != std::numeric_limits<float>::infinity() || x == 0 || y == 0 || x + 1 == w || y + 1 == h)
+					continue;
+
+				int count = 0, closest = -1;
+				for(int dy = -1; dy <= 1; ++dy)
+					for(int dx = -1; dx <= 1; ++dx) {
+						const int n = index + dy * w + dx;
+						if(covered[n] != std::numeric_limits<float>::infinity()) {
+							++count;
+							if(closest < 0 || covered[n] < covered[closest])
+								closest = n;
+						}
+					}
+
+				if(count >= 5) {
+					filled[index] = covered[closest];
+					gbuffer.positions[index] = gbuffer.positions[closest];
+					gbuffer.normals[index] = gbuffer.normals[closest];
+					gbuffer.colors[index] = gbuffer.colors[closest];
+				}
+			}
+		});
+
+		depth = &filled;
+	}
+
+	copyRows(gbuffer.colors.data(), w * sizeof(Uint32), pixels, pitch, w, h);
+
+	// the remaining holes (disocclusions, newly visible parts of the scene and the background) are traced and shaded
+	// in small tiles
+	const int tilesX = (w + s_holeTileSize - 1) / s_holeTileSize;
+	const int tilesY = (h + s_holeTileSize - 1) / s_holeTileSize;
+	tbb::parallel_for(0, tilesX * tilesY, [&](int t) {
+		const int xMin = (t % tilesX) * s_holeTileSize;
+		const int xMax = std::min(xMin + s_holeTileSize, w);
+		const int yMin = (t / tilesX) * s_holeTileSize;
+		const int yMax = std::min(yMin + s_holeTileSize, h);
+
+		bool hole = false;
+		for(int y = yMin; y < yMax && !hole; ++y)
+			for(int x = xMin; x < xMax && !hole; ++x)
+				hole = (*depth)[y * w + x] == std::numeric_limits<float>::infinity();
+
+		if(hole) {
+			traceTile(gbuffer, xMin, xMax, yMin, yMax);
+			shadeTile(gbuffer, xMin, xMax, yMin, yMax, pixels, pitch, format, 0, nullptr);
+		}
+	});
+
+	if(m_rendering) {
+		copyRows(pixels, pitch, gbuffer.colors.data(), w * sizeof(Uint32), w, h);
+
+		// the reprojected image replaces all the levels, and is refined by the following passes
+		m_currentTexture = m_textures.size();
+
+		recordTime(m_statistics.reprojectionTime, start, rays);
+
+		std::lock_guard<std::mutex> lock(m_publishMutex);
+		publish(level, -1, true);
+	}
+}
+
 void Renderer::initTextures() {
 	stopRenderThread();
 
 	int w, h;
 	SDL_GetWindowSize(m_window, &w, &h);
 
+	// frames already published with the previous textures are dropped by update()
+	m_displayedTexture = -1;
+
+	{
+		std::lock_guard<std::mutex> lock(m_idsMutex);
+		m_ids.valid = false;
+
+		// the finest level has the size of the window
+		m_ids.distances.reserve(w * h);
+		m_ids.geomIDs.reserve(w * h);
+		m_ids.instIDs.reserve(w * h * RTC_MAX_INSTANCE_LEVEL_COUNT);
+	}
+
+	auto fb = m_framebuffers.rbegin();
 	for(std::vector<std::unique_ptr<Texture>>::reverse_iterator it = m_textures.rbegin(); it != m_textures.rend(); ++it) {
 		*it = std::unique_ptr<Texture>(new Texture(m_renderer, SDL_GetWindowSurface(m_window)->format->format,
 		                               SDL_TEXTUREACCESS_STREAMING, w, h));
 
+		*fb = std::unique_ptr<Framebuffer>(new Framebuffer(w, h));
+		++fb;
+
 		w /= 2;
 		h /= 2;
 	}
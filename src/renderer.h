@@ -3,46 +3,246 @@
 #include <vector>
 #include <memory>
 #include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <condition_variable>
 
 #include <SDL2/SDL.h>
 
 #include "scene.h"
 #include "texture.h"
+#include "framebuffer.h"
+#include "triple_buffer.h"
 
 class Renderer : public boost::noncopyable {
 	public:
+		enum Mode {
+			kFacingRatio,
+			kAmbientOcclusion,
+			kDirectionalLight,
+			kPathTracing
+		};
+
+		/// Settings of the ambient occlusion mode
+		struct AmbientOcclusion {
+			/// number of occlusion rays per pixel in each pass
+			unsigned samples = 4;
+			/// number of passes accumulated at full resolution
+			unsigned passes = 64;
+			/// maximum length of occlusion rays; 0 uses 10% of the scene size
+			float distance = 0.0f;
+		};
+
+		/// Settings of the diffuse path tracing mode, lit by a uniform white sky
+		struct PathTracing {
+			/// maximum number of diffuse bounces of each path
+			unsigned bounces = 4;
+			/// number of passes accumulated at full resolution
+			unsigned passes = 256;
+			/// reflectance of all surfaces
+			float albedo = 0.7f;
+		};
+
 		Renderer(const Scene& scene, SDL_Window* window, SDL_Renderer* renderer);
 		~Renderer();
 
+		void setMode(Mode mode);
+		Mode mode() const;
+
+		/// changes the ambient occlusion settings, applied when the rendering restarts (e.g., on the next camera change)
+		void setAmbientOcclusion(const AmbientOcclusion& ao);
+
+		/// changes the path tracing settings, applied when the rendering restarts
+		void setPathTracing(const PathTracing& pt);
+
+		/// direction towards the light of the kDirectionalLight mode; changing it only retraces shadow rays, and doesn't
+		/// restart the rendering in the other modes
+		void setLight(const Vec3& direction);
+		const Vec3& light() const;
+
 		void setCamera(Camera& cam);
-		Ray cameraRay(int x, int y, int w, int h) const;
 
 		void resize(std::size_t /*w*/, std::size_t /*h*/);
 
+		/// uploads the latest image published by the render thread (if any) to its texture - returns true if there is
+		/// a new image to show. Main thread only.
+		bool update();
+
+		/// the texture of the last uploaded image
 		SDL_Texture* texture();
+		/// resolution level of the last uploaded image, or -1 if there is none yet
 		int currentTexture() const;
+		/// number of accumulated full-resolution passes, increasing while the image is progressively refined
+		int currentPass() const;
+
+		/// The primary hit of a pixel, as kept in the ID buffer of the renderer
+		struct Hit {
+			/// distance along the camera ray, infinite if the pixel has no hit
+			float distance;
+			unsigned geomID;
+			/// Embree's instance stack of the hit
+			unsigned instID[RTC_MAX_INSTANCE_LEVEL_COUNT];
+		};
+
+		/// looks up the primary hit of a pixel of a w x h view in the finest completed level, without tracing a ray.
+		/// Returns false if there is no level of this camera view yet - the caller then has to trace the ray itself.
+		bool pick(const Camera& camera, int x, int y, int w, int h, Hit& hit) const;
+
+		/// Timings of the current view, for the HUD
+		struct Statistics {
+			/// render time of each resolution level in ms (0 for the levels not rendered yet)
+			std::vector<float> levelTimes;
+			/// render time of the last accumulation pass and of the reprojection in ms (0 if there was none)
+			float passTime = 0.0f, reprojectionTime = 0.0f;
+			/// rays of all types traced per second during the last level or pass
+			double raysPerSecond = 0.0;
+			/// number of threads currently tracing or shading tiles, and the size of the thread pool rendering them
+			int activeThreads = 0, threads = 0;
+		};
+
+		Statistics statistics() const;
+
+		/// type of the SDL user event posted (from the render thread) whenever a new level or pass is ready to be shown
+		Uint32 readyEvent() const;
 
 	private:
+		/// Primary hits of one resolution level, reused until the camera changes
+		struct GBuffer {
+			int width = 0, height = 0;
+			std::vector<Vec3> positions;
+			/// world-space normals facing the camera, zero for pixels without a hit
+			std::vector<Vec3> normals;
+			/// the shaded image of the level, kept as the source of reprojection
+			std::vector<Uint32> colors;
+			/// hit IDs of the primary rays, copied to the ID buffer when the level is complete
+			std::vector<float> distances;
+			std::vector<unsigned> geomIDs;
+			/// RTC_MAX_INSTANCE_LEVEL_COUNT consecutive values per pixel
+			std::vector<unsigned> instIDs;
+			/// 1 for pixels not traced from the current camera yet (e.g., reprojected ones), 0 for traced ones
+			std::vector<Uint8> stale;
+			/// traced from the current camera; reprojected or partially retraced G-buffers are not valid
+			bool valid = false;
+		};
+
+		/// An image published by the render thread, with the tiles that changed since the last consumed image of its level
+		struct Frame {
+			Framebuffer image;
+			int level = -1;
+			/// one flag per tile, in row-major order - only these tiles of the image are valid
+			std::vector<bool> dirty;
+			/// false while the tiles of a level of a new view are still being rendered, so that it is not shown yet
+			bool complete = false;
+		};
+
+		/// Hit IDs of the finest completed level of a camera view, read by the main thread for picking. Its storage is
+		/// reserved for the full resolution, so copying a level into it does not allocate.
+		struct IdBuffer {
+			int width = 0, height = 0;
+			Camera camera;
+			std::vector<float> distances;
+			std::vector<unsigned> geomIDs, instIDs;
+			bool valid = false;
+		};
+
+		/// (re)starts rendering on the persistent render thread, which keeps refining the image until it is stopped
 		void startRenderThread();
+		/// interrupts the rendering, and waits until the render thread is idle
 		void stopRenderThread();
+		void renderLoop();
 
 		void renderAll();
 		void renderFrame(SDL_PixelFormat format);
-		void renderTile(int xMin, int xMax, int yMin, int yMax, Uint32* pixels, int pitch, int w, int h, SDL_PixelFormat format);
+		void renderTileFacing(const GBuffer& gbuffer, int xMin, int xMax, int yMin, int yMax, Uint32* pixels, int pitch, SDL_PixelFormat format);
+		/// makes the initial full-resolution image of a new camera view from the previous one, tracing only its holes
+		void reproject(SDL_PixelFormat format);
+		void traceTile(GBuffer& gbuffer, int xMin, int xMax, int yMin, int yMax);
+		void renderTileAO(const GBuffer& gbuffer, int xMin, int xMax, int yMin, int yMax, Uint32* pixels, int pitch, SDL_PixelFormat format,
+		                  unsigned pass, float* accumulation);
+		void renderTileLight(const GBuffer& gbuffer, int xMin, int xMax, int yMin, int yMax, Uint32* pixels, int pitch, SDL_PixelFormat format);
+		void renderTilePath(const GBuffer& gbuffer, int xMin, int xMax, int yMin, int yMax, Uint32* pixels, int pitch, SDL_PixelFormat format,
+		                    unsigned pass, float* accumulation);
+		/// renders a tile in the current mode from the primary hits of the G-buffer
+		void shadeTile(const GBuffer& gbuffer, int xMin, int xMax, int yMin, int yMax, Uint32* pixels, int pitch, SDL_PixelFormat format,
+		               unsigned pass, float* accumulation);
+		/// number of accumulated full-resolution passes of the current mode
+		unsigned passCount() const;
+		void renderPass(SDL_PixelFormat format);
 
 		void initTextures();
+		/// publishes a completed tile of a level's framebuffer (or the whole level if tile < 0) to the main thread. Tiles
+		/// are accumulated while the main thread has not consumed the previous frame, except for the last tile of a level
+		/// or pass. Called from the render workers, with m_publishMutex locked.
+		void publish(int level, int tile, bool last);
+		void notifyReady();
+		/// copies the hit IDs of a completed level to the ID buffer - levels complete from the coarsest one, so it always
+		/// holds the finest completed level
+		void publishIds(const GBuffer& gbuffer);
+		/// stores the render time of a level or pass, and the ray throughput since its start
+		void recordTime(float& time, const std::chrono::steady_clock::time_point& start, std::uint64_t rays);
 
 		const Scene* m_scene;
 		SDL_Window* m_window;
 		SDL_Renderer* m_renderer;
 
+		/// the textures of all resolution levels are only accessed by the main thread, which uploads the framebuffers
+		/// rendered by the render thread
 		std::vector<std::unique_ptr<Texture>> m_textures;
-		int m_currentTexture;
+		std::vector<std::unique_ptr<Framebuffer>> m_framebuffers;
+		/// number of completed levels (render thread), and the level of the displayed texture (main thread)
+		int m_currentTexture, m_displayedTexture;
+
+		TripleBuffer<Frame> m_frames;
+		std::mutex m_publishMutex;
 
 		Camera m_camera;
 
-		bool m_rendering;
+		Mode m_mode;
+		AmbientOcclusion m_ao;
+		float m_aoDistance, m_aoBias;
+		PathTracing m_pt;
+		/// size of the cells used to sort path tracing rays by their origin
+		float m_binSize;
+
+		Vec3 m_light;
+
+		std::vector<GBuffer> m_gbuffers;
+
+		/// the last completed level of a previous camera view (positions are in world space, so its camera isn't needed)
+		GBuffer m_previous;
+		bool m_reproject;
+
+		/// scratch buffers of reproject(), reallocated only when the size changes: the closest projected sample of each
+		/// pixel (distance and source index), and the depths of the crack filling iterations (alternating buffers)
+		std::unique_ptr<std::atomic<std::uint64_t>[]> m_projected;
+		std::size_t m_projectedSize;
+		std::vector<float> m_depth[2];
+
+		IdBuffer m_ids;
+		mutable std::mutex m_idsMutex;
+
+		Statistics m_statistics;
+		mutable std::mutex m_statisticsMutex;
+		/// total number of rays traced
+		std::atomic<std::uint64_t> m_rayCount;
+		/// number of workers inside traceTile() or shadeTile()
+		std::atomic<int> m_activeWorkers;
+
+		/// progressive accumulation of full-resolution passes - the sum of all passes
+		std::vector<float> m_accumulation;
+		std::atomic<int> m_pass;
+
+		Uint32 m_readyEvent;
+
+		std::atomic<bool> m_rendering;
 		std::unique_ptr<std::thread> m_thread;
 
+		/// state of the render thread, guarded by m_threadMutex - busy while rendering, quit on destruction
+		std::mutex m_threadMutex;
+		std::condition_variable m_threadCondition;
+		bool m_busy, m_quit;
+
 		int m_width, m_height;
 };
@@ -7,6 +7,9 @@
 #include <embree3/rtcore_ray.h>
 
 #include "mesh.h"
+#include "subdivision.h"
+#include "curves.h"
+#include "profiling.h"
 
 Scene::SceneHandle::SceneHandle(Device& device) {
 	m_scene = rtcNewScene(device);
@@ -28,35 +31,127 @@ Scene::SceneHandle::operator const RTCScene& () const {
 
 ////////////
 
-Scene::Scene() : m_scene(new SceneHandle(m_device)) {
+namespace {
+
+/// degenerate triangles don't have a normal - their zero vectors are kept
+Vec3 normalized(const Vec3& v) {
+	const float length = v.length();
+	return length > 0.0f ? v * (1.0f / length) : v;
+}
+
+/// true if two hits are in the same instance
+bool sameInstance(const RTCHit& a, const RTCHit& b) {
+	for(unsigned l = 0; l < RTC_MAX_INSTANCE_LEVEL_COUNT; ++l) {
+		if(a.instID[l] != b.instID[l])
+			return false;
+		if(a.instID[l] == RTC_INVALID_GEOMETRY_ID)
+			break;
+	}
+
+	return true;
+}
+
+}
+
+////////////
+
+Vec3 Scene::NormalTransform::operator()(const Vec3& n) const {
+	return x * n.x + y * n.y + z * n.z;
+}
+
+Scene::NormalTransform Scene::NormalTransform::operator * (const NormalTransform& t) const {
+	NormalTransform result;
+	result.x = (*this)(t.x);
+	result.y = (*this)(t.y);
+	result.z = (*this)(t.z);
+
+	return result;
+}
+
+////////////
+
+Scene::Scene() : m_scene(new SceneHandle(m_device)), m_geometries(new std::vector<Geometry>()) {
 }
 
 Scene::~Scene() {
 }
 
-Scene::Scene(Scene&& s) : m_device(s.m_device), m_scene(std::move(s.m_scene)) {
+Scene::Scene(Scene&& s) : m_device(s.m_device), m_storage(std::move(s.m_storage)), m_scene(std::move(s.m_scene)),
+	m_geometries(std::move(s.m_geometries)), m_statistics(s.m_statistics) {
 }
 
 Scene& Scene::operator = (Scene&& s) {
 	if(&s != this) {
 		m_device = s.m_device;
 		m_scene = std::move(s.m_scene);
+		m_storage = std::move(s.m_storage);
+		m_geometries = std::move(s.m_geometries);
+		m_statistics = s.m_statistics;
 	}
 
 	return *this;
 }
 
+Scene::Geometry& Scene::addGeometry(unsigned geomID) {
+	// Embree assigns the IDs of a new scene in order
+	if(m_geometries->size() <= geomID)
+		m_geometries->resize(geomID + 1);
+
+	return (*m_geometries)[geomID];
+}
+
 unsigned Scene::addMesh(Mesh&& geom) {
+	LoadPhaseScope phase(kBufferFill);
+
+	unsigned int geomID = rtcAttachGeometry(*m_scene, geom.geom());
+
+	m_statistics.primitives += geom.triangleCount();
+
+	if(geom.storage())
+		m_storage.insert(geom.storage());
+
+	// meshes with normals store them as vertex attribute 0, and point their user data at them
+	addGeometry(geomID).interpolated = rtcGetGeometryUserData(geom.geom()) != nullptr ? geom.geom() : nullptr;
+
+	rtcCommitGeometry(geom.geom());
+
+	return geomID;
+}
+
+unsigned Scene::addMesh(SubdivisionMesh&& geom) {
+	LoadPhaseScope phase(kBufferFill);
+
 	unsigned int geomID = rtcAttachGeometry(*m_scene, geom.geom());
 
+	m_statistics.primitives += geom.faces().size();
+
+	addGeometry(geomID);
+
+	rtcCommitGeometry(geom.geom());
+
+	return geomID;
+}
+
+unsigned Scene::addMesh(Curves&& geom) {
+	LoadPhaseScope phase(kBufferFill);
+
+	unsigned int geomID = rtcAttachGeometry(*m_scene, geom.geom());
+
+	m_statistics.primitives += geom.segments().size();
+
+	addGeometry(geomID);
+
 	rtcCommitGeometry(geom.geom());
 
 	return geomID;
 }
 
 unsigned Scene::addInstance(const Scene& s, const Mat4& _tr) {
+	LoadPhaseScope phase(kBufferFill);
+
 	RTCGeometry instance = rtcNewGeometry(m_device, RTC_GEOMETRY_TYPE_INSTANCE);
 	rtcSetGeometryInstancedScene(instance, *s.m_scene);
+	m_storage.insert(s.m_storage.begin(), s.m_storage.end());
 	unsigned int geomID = rtcAttachGeometry(*m_scene, instance);
 	rtcReleaseGeometry(instance);
 
@@ -65,35 +160,29 @@ unsigned Scene::addInstance(const Scene& s, const Mat4& _tr) {
 
 	rtcSetGeometryTransform(instance, 0, RTC_FORMAT_FLOAT4X4_COLUMN_MAJOR, tr.m);
 
+	// the cofactor matrix of the upper 3x3 part, from the cross products of its columns
+	const Vec3 a(tr[0][0], tr[0][1], tr[0][2]);
+	const Vec3 b(tr[1][0], tr[1][1], tr[1][2]);
+	const Vec3 c(tr[2][0], tr[2][1], tr[2][2]);
+
+	Geometry& geometry = addGeometry(geomID);
+	geometry.instanced = s.m_geometries;
+	geometry.normals.x = b.cross(c);
+	geometry.normals.y = c.cross(a);
+	geometry.normals.z = a.cross(b);
+
 	rtcCommitGeometry(instance);
 
+	m_statistics.primitives += s.m_statistics.primitives;
+	m_statistics.instances += s.m_statistics.instances + 1;
+
 	return geomID;
 }
 
 void Scene::commit() {
-	rtcCommitScene(*m_scene);
-}
-
-Vec3 Scene::renderPixel(const Ray& r) const {
-	RTCRayHit rayhit = trace(r);
-
-	Vec3 color{0, 0, 0};
-
-	if(rayhit.hit.geomID != RTC_INVALID_GEOMETRY_ID) {
-		//color = Vec3{(float)(rayhit.hit.geomID & 1), (float)((rayhit.hit.geomID >> 1) & 1), (float)((rayhit.hit.geomID >> 2) & 1)};
-		color = Vec3(1, 1, 1);
+	TraceScope scope("Scene::commit");
 
-		Vec3 norm(rayhit.hit.Ng_x, rayhit.hit.Ng_y, rayhit.hit.Ng_z);
-		norm.normalize();
-
-		const float d = std::abs(r.direction.dot(norm));
-
-		color.x *= d;
-		color.y *= d;
-		color.z *= d;
-	}
-
-	return color;
+	rtcCommitScene(*m_scene);
 }
 
 RTCRayHit Scene::trace(const Ray& r) const {
@@ -125,3 +214,99 @@ RTCRayHit Scene::trace(const Ray& r) const {
 
 	return rayhit;
 }
+
+void Scene::intersect(RTCRayHit* rays, std::size_t count, bool coherent) const {
+	RTCIntersectContext context;
+	rtcInitIntersectContext(&context);
+	context.flags = coherent ? RTC_INTERSECT_CONTEXT_FLAG_COHERENT : RTC_INTERSECT_CONTEXT_FLAG_INCOHERENT;
+
+	rtcIntersect1M(*m_scene, &context, rays, count, sizeof(RTCRayHit));
+}
+
+void Scene::occluded(RTCRay* rays, std::size_t count, bool coherent) const {
+	RTCIntersectContext context;
+	rtcInitIntersectContext(&context);
+	context.flags = coherent ? RTC_INTERSECT_CONTEXT_FLAG_COHERENT : RTC_INTERSECT_CONTEXT_FLAG_INCOHERENT;
+
+	rtcOccluded1M(*m_scene, &context, rays, count, sizeof(RTCRay));
+}
+
+const std::vector<Scene::Geometry>& Scene::resolve(const RTCHit& hit, NormalTransform& normals) const {
+	normals = NormalTransform();
+
+	const std::vector<Geometry>* geometries = m_geometries.get();
+	for(unsigned l = 0; l < RTC_MAX_INSTANCE_LEVEL_COUNT && hit.instID[l] != RTC_INVALID_GEOMETRY_ID; ++l) {
+		const Geometry& instance = (*geometries)[hit.instID[l]];
+
+		normals = normals * instance.normals;
+		geometries = instance.instanced.get();
+	}
+
+	return *geometries;
+}
+
+Vec3 Scene::worldNormal(const RTCHit& hit, const Geometry& geometry, const NormalTransform& normals, Vec3* shading) {
+	// Ng is in the object space of the hit geometry
+	const Vec3 n(hit.Ng_x, hit.Ng_y, hit.Ng_z);
+
+	if(shading != nullptr) {
+		Vec3 s = n;
+
+		if(geometry.interpolated != nullptr) {
+			float interpolated[3];
+			rtcInterpolate0(geometry.interpolated, hit.primID, hit.u, hit.v, RTC_BUFFER_TYPE_VERTEX_ATTRIBUTE, 0, interpolated, 3);
+
+			const Vec3 v(interpolated[0], interpolated[1], interpolated[2]);
+			if(v.length() > 0.0f)
+				s = v;
+		}
+
+		*shading = normalized(normals(s));
+	}
+
+	return normalized(normals(n));
+}
+
+Vec3 Scene::worldNormal(const RTCHit& hit, Vec3* shading) const {
+	NormalTransform normals;
+	const std::vector<Geometry>& geometries = resolve(hit, normals);
+
+	return worldNormal(hit, geometries[hit.geomID], normals, shading);
+}
+
+void Scene::worldNormals(const RTCRayHit* rays, std::size_t count, Vec3* geometric, Vec3* shading) const {
+	// the last resolved instance path - coherent rays mostly hit the same instance as the previous ray
+	const RTCHit* last = nullptr;
+	const std::vector<Geometry>* geometries = nullptr;
+	NormalTransform normals;
+
+	for(std::size_t i = 0; i < count; ++i) {
+		const RTCHit& hit = rays[i].hit;
+
+		if(hit.geomID == RTC_INVALID_GEOMETRY_ID) {
+			geometric[i] = Vec3(0, 0, 0);
+			if(shading != nullptr)
+				shading[i] = Vec3(0, 0, 0);
+
+			continue;
+		}
+
+		if(last == nullptr || !sameInstance(hit, *last)) {
+			geometries = &resolve(hit, normals);
+			last = &hit;
+		}
+
+		geometric[i] = worldNormal(hit, (*geometries)[hit.geomID], normals, shading != nullptr ? &shading[i] : nullptr);
+	}
+}
+
+float Scene::size() const {
+	RTCBounds bounds;
+	rtcGetSceneBounds(*m_scene, &bounds);
+
+	return Vec3(bounds.upper_x - bounds.lower_x, bounds.upper_y - bounds.lower_y, bounds.upper_z - bounds.lower_z).length();
+}
+
+const Scene::Statistics& Scene::statistics() const {
+	return m_statistics;
+}
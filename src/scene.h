@@ -1,6 +1,8 @@
 #pragma once
 
 #include <memory>
+#include <set>
+#include <vector>
 
 #include <boost/noncopyable.hpp>
 
@@ -11,9 +13,19 @@
 #include "device.h"
 
 class Mesh;
+class SubdivisionMesh;
+class Curves;
 
 class Scene : public boost::noncopyable {
 	public:
+		/// Geometry counts of a scene, with the content of each instance counted again (i.e., as rendered)
+		struct Statistics {
+			/// triangles, subdivision faces and curve segments
+			std::size_t primitives = 0;
+			/// instances of all levels
+			std::size_t instances = 0;
+		};
+
 		Scene();
 		~Scene();
 
@@ -24,13 +36,31 @@ class Scene : public boost::noncopyable {
 		Scene& operator = (Scene&& s);
 
 		unsigned addMesh(Mesh&& geom);
+		unsigned addMesh(SubdivisionMesh&& geom);
+		unsigned addMesh(Curves&& geom);
 		unsigned addInstance(const Scene& scene, const Mat4& tr = Mat4());
 
 		void commit();
 
-		Vec3 renderPixel(const Ray& r) const;
 		RTCRayHit trace(const Ray& r) const;
 
+		/// intersects a batch of rays (e.g., all primary rays of a tile) using a single stream query
+		void intersect(RTCRayHit* rays, std::size_t count, bool coherent = true) const;
+		/// tests a batch of rays for occlusion - occluded rays have their tfar set to -inf
+		void occluded(RTCRay* rays, std::size_t count, bool coherent = false) const;
+
+		/// world-space geometric normal of a hit, transformed through all the levels of instancing. If shading is not null,
+		/// it receives the interpolated vertex normal of meshes that have normals (and the geometric normal otherwise).
+		Vec3 worldNormal(const RTCHit& hit, Vec3* shading = nullptr) const;
+		/// worldNormal() of a batch of hits (e.g., all primary hits of a tile), reusing the transformation of consecutive
+		/// hits of the same instance. Rays without a hit get zero normals.
+		void worldNormals(const RTCRayHit* rays, std::size_t count, Vec3* geometric, Vec3* shading) const;
+
+		/// length of the diagonal of the scene's bounding box
+		float size() const;
+
+		const Statistics& statistics() const;
+
 	private:
 		class SceneHandle {
 			public:
@@ -47,7 +77,43 @@ class Scene : public boost::noncopyable {
 				RTCScene m_scene;
 		};
 
+		/// Transformation of normals by an instance - the cofactor matrix of the upper 3x3 part of its transformation
+		/// (the inverse transpose, up to scale), as columns
+		struct NormalTransform {
+			Vec3 x = Vec3(1, 0, 0), y = Vec3(0, 1, 0), z = Vec3(0, 0, 1);
+
+			Vec3 operator()(const Vec3& n) const;
+			/// the transformation applying t first
+			NormalTransform operator * (const NormalTransform& t) const;
+		};
+
+		/// What the normals of a hit need from a geometry of the scene. Embree provides the transformations of
+		/// instances, but not their instanced scenes, and looking them up for each hit is slow.
+		struct Geometry {
+			/// geometries of the instanced scene, by geomID (null if the geometry is not an instance)
+			std::shared_ptr<const std::vector<Geometry>> instanced;
+			NormalTransform normals;
+			/// the geometry, if it is a mesh with vertex normals to interpolate (null otherwise)
+			RTCGeometry interpolated = nullptr;
+		};
+
+		/// the geometries of the (instanced) scene of a hit, and the transformation of its instance levels
+		const std::vector<Geometry>& resolve(const RTCHit& hit, NormalTransform& normals) const;
+		/// the geometric and shading normals of a hit on a geometry, transformed to world space
+		static Vec3 worldNormal(const RTCHit& hit, const Geometry& geometry, const NormalTransform& normals, Vec3* shading);
+
+		/// adds the geometry of a new geomID
+		Geometry& addGeometry(unsigned geomID);
+
 		Device m_device;
 
+		/// external storage of shared geometry buffers (of this scene and all instanced scenes), which needs to outlive the scene
+		std::set<std::shared_ptr<const void>> m_storage;
+
 		std::unique_ptr<SceneHandle> m_scene;
+
+		/// geometries of the scene, by geomID - shared with the scenes instancing it
+		std::shared_ptr<std::vector<Geometry>> m_geometries;
+
+		Statistics m_statistics;
 };
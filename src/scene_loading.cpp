@@ -6,29 +6,40 @@
 
 #include "alembic.h"
 #include "obj.h"
+#include "gltf.h"
+#include "profiling.h"
 
 namespace {
 
-std::shared_ptr<Scene> parseMesh(const boost::filesystem::path& p) {
+/// the commit is profiled as commitPhase - a mesh file is the top level of a scene only if it is loaded on its own
+std::shared_ptr<Scene> parseMesh(const boost::filesystem::path& p, StripCurves strips = kNoStripCurves, LoadPhase commitPhase = kLevelCommit) {
+	TraceScope scope("parseMesh");
+
 	std::unique_ptr<Scene> result(new Scene());
 
 	if(p.extension() == ".abc")
 		*result = loadAlembic(p);
 
 	else if(p.extension() == ".obj")
-		*result = loadObj(p);
+		*result = loadObj(p, strips);
+
+	else if(p.extension() == ".glb")
+		*result = loadGltf(p);
 
 	else
 		throw std::runtime_error("unknown mesh file format - " + p.string());
 
-	result->commit();
+	{
+		LoadPhaseScope phase(commitPhase);
+		result->commit();
+	}
 
 	return std::shared_ptr<Scene>(result.release());
 }
 }
 
-Scene loadMesh(const boost::filesystem::path& p) {
-	std::shared_ptr<Scene> result = parseMesh(p);
+Scene loadMesh(const boost::filesystem::path& p, StripCurves strips) {
+	std::shared_ptr<Scene> result = parseMesh(p, strips, kTopLevelCommit);
 
 	return std::move(*result);
 }
@@ -39,6 +50,21 @@ struct Instance {
 	Mat4 transform;
 };
 
+StripCurves parseStripCurves(const nlohmann::json& source) {
+	if(!source.is_string())
+		throw std::runtime_error("curves attribute should be a string");
+
+	const std::string value = source.get<std::string>();
+	if(value == "linear")
+		return kLinearStripCurves;
+	if(value == "bezier")
+		return kBezierStripCurves;
+	if(value == "none")
+		return kNoStripCurves;
+
+	throw std::runtime_error("unknown curves type - " + value);
+}
+
 Mat4 parseMat4(const nlohmann::json& source) {
 	assert(source.is_array() && source.size() == 16);
 
@@ -56,12 +82,17 @@ std::shared_ptr<Scene> parseSubScene(const nlohmann::json& source, const boost::
 	for(const auto& m : source)
 		scene->addInstance(std::move(*parseObject(m, scene_root, instances)));
 
-	scene->commit();
+	{
+		LoadPhaseScope phase(kLevelCommit);
+		scene->commit();
+	}
 
 	return scene;
 }
 
 std::shared_ptr<Scene> parseObject(const nlohmann::json& source, const boost::filesystem::path& scene_root, std::map<std::string, std::shared_ptr<Scene>>& instances) {
+	TraceScope scope("parseObject");
+
 	std::shared_ptr<Scene> scene(new Scene());
 
 	auto path = source.find("path");
@@ -73,6 +104,8 @@ std::shared_ptr<Scene> parseObject(const nlohmann::json& source, const boost::fi
 
 	auto scene_path = source.find("scene_path");
 
+	auto curves = source.find("curves");
+
 	Mat4 parentTransform;
 	if(transform != source.end()) {
 		assert(transform->is_array() && transform->size() == 16);
@@ -97,7 +130,7 @@ std::shared_ptr<Scene> parseObject(const nlohmann::json& source, const boost::fi
 			if(!boost::filesystem::exists(p))
 				throw std::runtime_error("file not found - " + p.string());
 
-			std::shared_ptr<Scene> item = parseMesh(p);
+			std::shared_ptr<Scene> item = parseMesh(p, curves != source.end() ? parseStripCurves(*curves) : kNoStripCurves);
 			scene->addInstance(*item, parentTransform);
 		}
 
@@ -133,18 +166,21 @@ std::shared_ptr<Scene> parseObject(const nlohmann::json& source, const boost::fi
 				if(!boost::filesystem::exists(p))
 					throw std::runtime_error("file not found - " + p.string());
 
-				std::ifstream file(p.string(), std::ios_base::binary);
-
-				Instance i;
-				assert(sizeof(i) == 17 * 4); // id + 16 floats
+				static_assert(sizeof(Instance) == 17 * 4, "id + 16 floats");
 
-				while(!file.eof()) {
-					file.read((char*)&i, sizeof(Instance));
+				// read as a whole first, so that the I/O is not interleaved with building the instances
+				std::vector<Instance> records;
+				{
+					LoadPhaseScope phase(kFileIO);
 
-					if(!file.eof())
-						scene->addInstance(items[i.id], i.transform * parentTransform);
+					std::ifstream file(p.string(), std::ios_base::binary);
+					records.resize(boost::filesystem::file_size(p) / sizeof(Instance));
+					file.read((char*)records.data(), records.size() * sizeof(Instance));
+					records.resize(file.gcount() / sizeof(Instance));
 				}
 
+				for(auto& i : records)
+					scene->addInstance(items[i.id], i.transform * parentTransform);
 			}
 
 			// without instancing
@@ -174,13 +210,18 @@ std::shared_ptr<Scene> parseObject(const nlohmann::json& source, const boost::fi
 			instances.insert(std::make_pair(scene_path->get<std::string>(), scene));
 	}
 
-	scene->commit();
+	{
+		LoadPhaseScope phase(kLevelCommit);
+		scene->commit();
+	}
 
 	return scene;
 }
 }
 
 Scene parseScene(const nlohmann::json& source, const boost::filesystem::path& scene_root) {
+	TraceScope scope("parseScene");
+
 	Scene scene;
 
 	std::map<std::string, std::shared_ptr<Scene>> instances;
@@ -188,7 +229,10 @@ Scene parseScene(const nlohmann::json& source, const boost::filesystem::path& sc
 	for(const auto& m : source)
 		scene.addInstance(*parseObject(m, scene_root, instances));
 
-	scene.commit();
+	{
+		LoadPhaseScope phase(kTopLevelCommit);
+		scene.commit();
+	}
 
 	return scene;
 }
@@ -5,6 +5,7 @@
 #include "json.hpp"
 
 #include "scene.h"
+#include "obj.h"
 
-Scene loadMesh(const boost::filesystem::path& p);
+Scene loadMesh(const boost::filesystem::path& p, StripCurves strips = kNoStripCurves);
 Scene parseScene(const nlohmann::json& source, const boost::filesystem::path& scene_root);
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <cmath>
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+#include <SDL2/SDL.h>
+
+#include <embree3/rtcore_ray.h>
+
+#include "maths.h"
+#include "scene.h"
+
+// Per-pixel code of the renderer's tiles, inlined in its loops - shared with the ray_paths benchmarks, which measure
+// the same code rather than copies of it
+
+inline void initRay(RTCRay& ray, const Vec3& origin, const Vec3& direction, float tfar) {
+	ray.org_x = origin.x;
+	ray.org_y = origin.y;
+	ray.org_z = origin.z;
+
+	ray.tnear = 0;
+	ray.tfar = tfar;
+
+	ray.dir_x = direction.x;
+	ray.dir_y = direction.y;
+	ray.dir_z = direction.z;
+
+	ray.time = 0;
+
+	ray.mask = 0xFFFFFFFF;
+	ray.id = 0;
+	ray.flags = 0;
+}
+
+/// the primary ray of a pixel of a w x h image, without a hit
+inline void primaryRay(const Camera& camera, int x, int y, int w, int h, RTCRayHit& rayhit) {
+	const Ray r = camera.pixelRay(x, y, w, h);
+
+	initRay(rayhit.ray, r.origin, r.direction, std::numeric_limits<float>::infinity());
+	rayhit.hit.geomID = RTC_INVALID_GEOMETRY_ID;
+	rayhit.hit.instID[0] = RTC_INVALID_GEOMETRY_ID;
+}
+
+/// traces the primary rays of the [xMin, xMax) x [yMin, yMax) tile of a w x h image as a single coherent stream - rays
+/// keeps them with their hits, in the row-major order of the tile's pixels
+inline void tracePrimaryTile(const Scene& scene, const Camera& camera, int w, int h, int xMin, int xMax, int yMin, int yMax,
+                             std::vector<RTCRayHit>& rays) {
+	const int tileWidth = xMax - xMin;
+
+	rays.resize(tileWidth * (yMax - yMin));
+	for(int y = yMin; y < yMax; ++y)
+		for(int x = xMin; x < xMax; ++x)
+			primaryRay(camera, x, y, w, h, rays[(y - yMin) * tileWidth + (x - xMin)]);
+
+	scene.intersect(rays.data(), rays.size());
+}
+
+/// writes the G-buffer positions and normals of a tile's traced primary rays (see tracePrimaryTile()) into arrays of
+/// the whole w-wide image: the hit point and the shading normal facing the camera, or a zero normal without a hit
+inline void writePrimaryHits(const Scene& scene, const std::vector<RTCRayHit>& rays, int w, int xMin, int xMax, int yMin,
+                             Vec3* positions, Vec3* normals) {
+	const std::size_t tileWidth = xMax - xMin;
+
+	// neighbouring pixels mostly hit the same instance, whose transformation is then looked up only once
+	std::vector<Vec3> geometric(rays.size()), shading(rays.size());
+	scene.worldNormals(rays.data(), rays.size(), geometric.data(), shading.data());
+
+	for(std::size_t i = 0; i < rays.size(); ++i) {
+		const RTCRayHit& rayhit = rays[i];
+		const std::size_t index = (yMin + i / tileWidth) * w + xMin + i % tileWidth;
+
+		if(rayhit.hit.geomID == RTC_INVALID_GEOMETRY_ID)
+			normals[index] = Vec3(0, 0, 0);
+
+		else {
+			const Vec3 dir(rayhit.ray.dir_x, rayhit.ray.dir_y, rayhit.ray.dir_z);
+
+			// the shading normal, on the side of the surface facing the camera
+			Vec3 norm = shading[i];
+			if(geometric[i].dot(dir) > 0.0f)
+				norm = norm * -1.0f;
+
+			positions[index] = Vec3(rayhit.ray.org_x, rayhit.ray.org_y, rayhit.ray.org_z) + dir * rayhit.ray.tfar;
+			normals[index] = norm;
+		}
+	}
+}
+
+/// pixels without a hit are marked by a zero normal in the G-buffer
+inline bool hasHit(const Vec3& normal) {
+	return normal.x != 0.0f || normal.y != 0.0f || normal.z != 0.0f;
+}
+
+/// the facing ratio of a G-buffer pixel seen from a point (0 without a hit)
+inline float facingRatio(const Vec3& eye, const Vec3& position, const Vec3& normal) {
+	if(!hasHit(normal))
+		return 0.0f;
+
+	Vec3 view = position - eye;
+	view.normalize();
+
+	return std::abs(view.dot(normal));
+}
+
+/// an opaque gray pixel of a shaded value, clamped to 0..1
+inline Uint32 packGray(float value, const SDL_PixelFormat& format) {
+	const Uint8 c = (Uint8)(std::min(std::max(value, 0.0f), 1.0f) * 255.0f);
+	return SDL_MapRGBA(&format, c, c, c, 255);
+}
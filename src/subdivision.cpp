@@ -0,0 +1,112 @@
+#include "subdivision.h"
+
+#include <cassert>
+
+SubdivisionMesh::GeometryHandle::GeometryHandle(const Device& device) : m_geometry(rtcNewGeometry(device, RTC_GEOMETRY_TYPE_SUBDIVISION)) {
+}
+
+SubdivisionMesh::GeometryHandle::~GeometryHandle() {
+	rtcReleaseGeometry(m_geometry);
+}
+
+SubdivisionMesh::GeometryHandle::operator RTCGeometry& () {
+	return m_geometry;
+}
+
+SubdivisionMesh::GeometryHandle::operator const RTCGeometry& () const {
+	return m_geometry;
+}
+
+///////////////////
+
+template<typename T>
+Buffer<T> SubdivisionMesh::makeBuffer(RTCBufferType type, RTCFormat format, std::size_t count) {
+	// optional buffers are not created at all if empty
+	if(count == 0)
+		return Buffer<T>(nullptr, 0);
+
+	return Buffer<T>((T*)rtcSetNewGeometryBuffer(*m_geom, type, 0, format, sizeof(T), count), count);
+}
+
+SubdivisionMesh::SubdivisionMesh(std::size_t vertexCount, std::size_t faceCount, std::size_t indexCount,
+                                 std::size_t edgeCreaseCount, std::size_t vertexCreaseCount, std::size_t holeCount) :
+	m_geom(new GeometryHandle(m_device)),
+	m_vertices(makeBuffer<Vertex>(RTC_BUFFER_TYPE_VERTEX, RTC_FORMAT_FLOAT3, vertexCount)),
+	m_faces(makeBuffer<unsigned>(RTC_BUFFER_TYPE_FACE, RTC_FORMAT_UINT, faceCount)),
+	m_indices(makeBuffer<unsigned>(RTC_BUFFER_TYPE_INDEX, RTC_FORMAT_UINT, indexCount)),
+	m_edgeCreases(makeBuffer<Edge>(RTC_BUFFER_TYPE_EDGE_CREASE_INDEX, RTC_FORMAT_UINT2, edgeCreaseCount)),
+	m_edgeCreaseWeights(makeBuffer<float>(RTC_BUFFER_TYPE_EDGE_CREASE_WEIGHT, RTC_FORMAT_FLOAT, edgeCreaseCount)),
+	m_vertexCreases(makeBuffer<unsigned>(RTC_BUFFER_TYPE_VERTEX_CREASE_INDEX, RTC_FORMAT_UINT, vertexCreaseCount)),
+	m_vertexCreaseWeights(makeBuffer<float>(RTC_BUFFER_TYPE_VERTEX_CREASE_WEIGHT, RTC_FORMAT_FLOAT, vertexCreaseCount)),
+	m_holes(makeBuffer<unsigned>(RTC_BUFFER_TYPE_HOLE, RTC_FORMAT_UINT, holeCount))
+{
+}
+
+SubdivisionMesh::~SubdivisionMesh() {
+}
+
+SubdivisionMesh::SubdivisionMesh(SubdivisionMesh&& m) : m_device(m.m_device), m_geom(std::move(m.m_geom)),
+	m_vertices(m.m_vertices), m_faces(m.m_faces), m_indices(m.m_indices), m_edgeCreases(m.m_edgeCreases),
+	m_edgeCreaseWeights(m.m_edgeCreaseWeights), m_vertexCreases(m.m_vertexCreases),
+	m_vertexCreaseWeights(m.m_vertexCreaseWeights), m_holes(m.m_holes) {
+}
+
+SubdivisionMesh& SubdivisionMesh::operator=(SubdivisionMesh&& m) {
+	m_device = m.m_device;
+	m_geom = std::move(m.m_geom);
+	m_vertices = m.m_vertices;
+	m_faces = m.m_faces;
+	m_indices = m.m_indices;
+	m_edgeCreases = m.m_edgeCreases;
+	m_edgeCreaseWeights = m.m_edgeCreaseWeights;
+	m_vertexCreases = m.m_vertexCreases;
+	m_vertexCreaseWeights = m.m_vertexCreaseWeights;
+	m_holes = m.m_holes;
+
+	return *this;
+}
+
+Buffer<Vertex>& SubdivisionMesh::vertices() {
+	return m_vertices;
+}
+
+Buffer<unsigned>& SubdivisionMesh::faces() {
+	return m_faces;
+}
+
+Buffer<unsigned>& SubdivisionMesh::indices() {
+	return m_indices;
+}
+
+Buffer<SubdivisionMesh::Edge>& SubdivisionMesh::edgeCreases() {
+	return m_edgeCreases;
+}
+
+Buffer<float>& SubdivisionMesh::edgeCreaseWeights() {
+	return m_edgeCreaseWeights;
+}
+
+Buffer<unsigned>& SubdivisionMesh::vertexCreases() {
+	return m_vertexCreases;
+}
+
+Buffer<float>& SubdivisionMesh::vertexCreaseWeights() {
+	return m_vertexCreaseWeights;
+}
+
+Buffer<unsigned>& SubdivisionMesh::holes() {
+	return m_holes;
+}
+
+void SubdivisionMesh::setTessellationRate(float rate) {
+	rtcSetGeometryTessellationRate(*m_geom, rate);
+}
+
+void SubdivisionMesh::setBoundaryMode(RTCSubdivisionMode mode) {
+	rtcSetGeometrySubdivisionMode(*m_geom, 0, mode);
+}
+
+const RTCGeometry& SubdivisionMesh::geom() const {
+	assert(m_geom != nullptr);
+	return *m_geom;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <memory>
+
+#include <embree3/rtcore_geometry.h>
+
+#include "maths.h"
+#include "device.h"
+#include "buffer.h"
+
+/// A non-copyable (only movable) representation of a Catmull-Clark subdivision surface control cage,
+/// tessellated by Embree on demand (using the device's tessellation cache).
+class SubdivisionMesh {
+	public:
+		struct Edge {
+			unsigned v0, v1;
+		};
+
+		SubdivisionMesh(std::size_t vertexCount, std::size_t faceCount, std::size_t indexCount,
+		                std::size_t edgeCreaseCount = 0, std::size_t vertexCreaseCount = 0, std::size_t holeCount = 0);
+		~SubdivisionMesh();
+
+		SubdivisionMesh(const SubdivisionMesh& m) = delete;
+		SubdivisionMesh& operator=(const SubdivisionMesh& m) = delete;
+
+		SubdivisionMesh(SubdivisionMesh&& m);
+		SubdivisionMesh& operator=(SubdivisionMesh&& m);
+
+		/// control vertices
+		Buffer<Vertex>& vertices();
+		/// number of vertices of each face
+		Buffer<unsigned>& faces();
+		/// vertex indices of all faces, stored consecutively
+		Buffer<unsigned>& indices();
+
+		Buffer<Edge>& edgeCreases();
+		Buffer<float>& edgeCreaseWeights();
+
+		Buffer<unsigned>& vertexCreases();
+		Buffer<float>& vertexCreaseWeights();
+
+		Buffer<unsigned>& holes();
+
+		void setTessellationRate(float rate);
+		void setBoundaryMode(RTCSubdivisionMode mode);
+
+		const RTCGeometry& geom() const;
+
+	private:
+		class GeometryHandle {
+			public:
+				GeometryHandle(const Device& device);
+				~GeometryHandle();
+
+				GeometryHandle(const GeometryHandle& m) = delete;
+				GeometryHandle& operator=(const GeometryHandle& m) = delete;
+
+				operator RTCGeometry& ();
+				operator const RTCGeometry& () const;
+
+			private:
+				RTCGeometry m_geometry;
+		};
+
+		template<typename T>
+		Buffer<T> makeBuffer(RTCBufferType type, RTCFormat format, std::size_t count);
+
+		Device m_device;
+		std::unique_ptr<GeometryHandle> m_geom;
+
+		Buffer<Vertex> m_vertices;
+		Buffer<unsigned> m_faces, m_indices;
+		Buffer<Edge> m_edgeCreases;
+		Buffer<float> m_edgeCreaseWeights;
+		Buffer<unsigned> m_vertexCreases;
+		Buffer<float> m_vertexCreaseWeights;
+		Buffer<unsigned> m_holes;
+};
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <atomic>
+
+/// A lock-free single-producer, single-consumer triple buffer. The producer fills back() and publishes it, receiving
+/// a free buffer in exchange. The consumer takes the most recently published buffer as front(), skipping any it
+/// missed. Neither side ever waits for the other.
+template<typename T>
+class TripleBuffer {
+	public:
+		TripleBuffer() : m_middle(1), m_back(2), m_front(0) {
+		}
+
+		/// the buffer owned by the producer
+		T& back() {
+			return m_buffers[m_back];
+		}
+
+		/// makes back() available to the consumer. Returns true if the previously published buffer was never consumed -
+		/// it then becomes the new back() buffer.
+		bool publish() {
+			const unsigned previous = m_middle.exchange(m_back | s_fresh);
+			m_back = previous & s_index;
+			return (previous & s_fresh) != 0;
+		}
+
+		/// true if the last published buffer was not consumed yet (a hint for the producer, as it can change at any time)
+		bool pending() const {
+			return (m_middle.load() & s_fresh) != 0;
+		}
+
+		/// takes the most recently published buffer as front(); returns false if nothing was published since the last call
+		bool consume() {
+			if((m_middle.load() & s_fresh) == 0)
+				return false;
+
+			m_front = m_middle.exchange(m_front) & s_index;
+			return true;
+		}
+
+		/// the buffer owned by the consumer
+		const T& front() const {
+			return m_buffers[m_front];
+		}
+
+	private:
+		static const unsigned s_index = 3;
+		static const unsigned s_fresh = 4;
+
+		T m_buffers[3];
+
+		/// index of the buffer shared between the two sides, with the s_fresh flag if it wasn't consumed yet
+		std::atomic<unsigned> m_middle;
+		unsigned m_back, m_front;
+};